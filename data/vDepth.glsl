@@ -6,7 +6,12 @@ uniform mat4 m; // model
 uniform mat4 v; // view
 uniform mat4 p; // perspective
 
+uniform bool packed;        // PackedVertex (see VertexPacking.h), the positions are fractions of the box at packedMin
+uniform vec3 packedMin;
+uniform vec3 packedExtent;
+
 void main()
 {
-	gl_Position = p*v*m*vec4(aPos, 1.0);
+	vec3 pos = packed ? packedMin + aPos * packedExtent : aPos;
+	gl_Position = p*v*m*vec4(pos, 1.0);
 }
\ No newline at end of file
@@ -7,6 +7,11 @@ layout (location = 2) in vec3 aCol;
 uniform mat4 m; // model
 uniform mat4 v; // view
 uniform mat4 p; // perspective
+
+uniform bool packed;        // PackedVertex (see VertexPacking.h), the positions are fractions of the box at packedMin
+uniform vec3 packedMin;
+uniform vec3 packedExtent;
+
 uniform vec4 ourColor;
 uniform float myTime;
 
@@ -23,19 +28,30 @@ out VS_OUT{
 	vec4 FragPosLightSpace;
 } vs_out;
 
+// octahedral normal, the two halves of the unit sphere folded out onto a square
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main()
 {
+	vec3 pos = packed ? packedMin + aPos * packedExtent : aPos;
+	vec3 normal = packed ? octDecode(aNormal.xy) : aNormal;
 
-    FragPos = vec3(v*m * vec4( aPos, 1.0)  );
-    Normal = transpose(inverse(mat3(v*m))) * aNormal;  
+    FragPos = vec3(v*m * vec4( pos, 1.0)  );
+    Normal = transpose(inverse(mat3(v*m))) * normal;  
 
     vs_out.FragPos = FragPos;
     vs_out.Normal = Normal;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * v*m*vec4(aPos, 1.0);
+    vs_out.FragPosLightSpace = lightSpaceMatrix * v*m*vec4(pos, 1.0);
     
     varyingColor = mix(vec4(aCol,1.0),ourColor,.5);
 
     
-    gl_Position = p * v * m * vec4(aPos, 1.0);
+    gl_Position = p * v * m * vec4(pos, 1.0);
 }
 
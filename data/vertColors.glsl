@@ -8,12 +8,17 @@ uniform mat4 m; // model
 uniform mat4 v; // view
 uniform mat4 p; // perspective
 
+uniform bool packed;        // PackedVertex (see VertexPacking.h), the positions are fractions of the box at packedMin
+uniform vec3 packedMin;
+uniform vec3 packedExtent;
+
 out vec4 vCol;
 out vec2 TexCoord;
 
 void main()
 {
+	vec3 pos = packed ? packedMin + aPos * packedExtent : aPos;
 	TexCoord = uv;
-	gl_Position = p*v*m*vec4(aPos, 1.0);
+	gl_Position = p*v*m*vec4(pos, 1.0);
 	vCol = vec4(aCol,1.0);
 }
\ No newline at end of file
@@ -8,6 +8,11 @@ layout (location = 3) in vec2 uv;
 uniform mat4 m; // model
 uniform mat4 v; // view
 uniform mat4 p; // perspective
+
+uniform bool packed;        // PackedVertex (see VertexPacking.h), the positions are fractions of the box at packedMin
+uniform vec3 packedMin;
+uniform vec3 packedExtent;
+
 uniform float myTime;
 uniform vec3 cPos;
 
@@ -26,19 +31,30 @@ out VS_OUT{
 	vec4 FragPosLightSpace;
 } vs_out;
 
+// octahedral normal, the two halves of the unit sphere folded out onto a square
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main()
 {
-	vec3 aPos1 = aPos ;//+ (aNorm*abs(sin(myTime))*20);
+	vec3 pos = packed ? packedMin + aPos * packedExtent : aPos;
+	vec3 normal = packed ? octDecode(aNorm.xy) : aNorm;
+	vec3 aPos1 = pos ;//+ (normal*abs(sin(myTime))*20);
 
 	TexCoord = uv.xy;
 
     FragPos = vec3(v*m*vec4(aPos1, 1.0));
-    Normal = normalize(mat3(transpose(inverse(v*m))) * normalize(aNorm)); 
+    Normal = normalize(mat3(transpose(inverse(v*m))) * normalize(normal)); 
 	r = reflect((FragPos-cPos),Normal);
 
     vs_out.FragPos = FragPos;
     vs_out.Normal = Normal;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * v*m*vec4(aPos, 1.0);
+    vs_out.FragPosLightSpace = lightSpaceMatrix * v*m*vec4(pos, 1.0);
 
     gl_Position = p*v*m*vec4(aPos1, 1.0);
     
@@ -0,0 +1,119 @@
+//
+// the asset loader's thread and the render thread's upload budget, see AssetLoader.h
+// nothing in here touches GL, the upload functions do that
+//
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <iostream>
+
+#include "AssetLoader.h"
+
+double assetUploadMilliseconds = 4.0;
+
+struct Asset {
+    std::function<void()> read;
+    std::function<bool()> upload;
+};
+
+static std::thread loaderThread;
+static std::mutex loaderLock;
+static std::condition_variable loaderWake;
+static bool loaderQuit = false;
+static std::deque<std::shared_ptr<Asset>> toRead;      // waiting for the loader thread
+static std::deque<std::shared_ptr<Asset>> toUpload;    // read, waiting for the render thread
+static unsigned reading = 0;                           // 1 while the loader thread is in a read()
+
+static std::chrono::steady_clock::time_point uploadDeadline;
+
+static void loaderLoop()
+{
+    for (;;) {
+        std::shared_ptr<Asset> asset;
+        {
+            std::unique_lock<std::mutex> lock(loaderLock);
+            loaderWake.wait(lock, []() { return loaderQuit || !toRead.empty(); });
+            if (loaderQuit)
+                return;
+            asset = toRead.front();
+            toRead.pop_front();
+            reading = 1;
+        }
+
+        asset->read();
+        asset->read = nullptr;
+
+        std::lock_guard<std::mutex> lock(loaderLock);
+        toUpload.push_back(asset);
+        reading = 0;
+    }
+}
+
+void loadInBackground(std::function<void()> read, std::function<bool()> upload)
+{
+    std::shared_ptr<Asset> asset = std::make_shared<Asset>();
+    asset->read = std::move(read);
+    asset->upload = std::move(upload);
+    {
+        std::lock_guard<std::mutex> lock(loaderLock);
+        loaderQuit = false;
+        toRead.push_back(asset);
+    }
+    // one thread is plenty, reads are mostly disk and the parsers spread themselves over the shared pool
+    if (!loaderThread.joinable())
+        loaderThread = std::thread(loaderLoop);
+    loaderWake.notify_one();
+}
+
+void updateAssetLoader()
+{
+    uploadDeadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(assetUploadMilliseconds * 1000));
+
+    do {
+        std::shared_ptr<Asset> asset;
+        {
+            std::lock_guard<std::mutex> lock(loaderLock);
+            if (toUpload.empty())
+                return;
+            asset = toUpload.front();
+        }
+        // the lock is not held while uploading, so the loader thread keeps going
+        if (!asset->upload())
+            return;
+
+        std::lock_guard<std::mutex> lock(loaderLock);
+        toUpload.pop_front();
+    } while (assetTimeLeft());
+}
+
+bool assetTimeLeft()
+{
+    return std::chrono::steady_clock::now() < uploadDeadline;
+}
+
+unsigned pendingAssets()
+{
+    std::lock_guard<std::mutex> lock(loaderLock);
+    return (unsigned)(toRead.size() + toUpload.size()) + reading;
+}
+
+void stopAssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(loaderLock);
+        loaderQuit = true;
+    }
+    loaderWake.notify_all();
+    if (loaderThread.joinable())
+        loaderThread.join();
+
+    std::lock_guard<std::mutex> lock(loaderLock);
+    if (!toRead.empty() || !toUpload.empty())
+        std::cout << "dropping " << toRead.size() + toUpload.size() << " assets that were still loading\n";
+    toRead.clear();
+    toUpload.clear();
+}
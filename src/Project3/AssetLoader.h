@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+
+// background loading for models and textures, so dropping a big model doesn't freeze the window
+//
+// read() runs on the loader thread and does everything that doesn't need GL : reading, parsing, decoding
+// (it may fan out over ThreadPool::shared() as well)
+// upload() then runs on the render thread from updateAssetLoader(), once a frame until it returns true,
+// it should hand GL a slice at a time and stop as soon as assetTimeLeft() says the frame's budget is spent
+// assets are read and uploaded in the order they were queued
+void loadInBackground(std::function<void()> read, std::function<bool()> upload);
+
+// call once a frame from the render thread, uploads for at most assetUploadMilliseconds
+// (the main loop does, whichever chapter is running, the texture budget queues restores from any of them)
+void updateAssetLoader();
+
+// false once this frame's upload budget is used up
+bool assetTimeLeft();
+
+// assets queued and not uploaded yet
+unsigned pendingAssets();
+
+// waits for the file being read (if any) and drops everything else, call before the GL context goes (the main loop does)
+void stopAssetLoader();
+
+// milliseconds a frame may spend on uploads, the asset at the front still gets one slice when it is over
+extern double assetUploadMilliseconds;
+
+// bytes handed to GL in one go by the uploads, small enough that a slice never blows the budget by much
+#define ASSET_UPLOAD_SLICE (256 * 1024)
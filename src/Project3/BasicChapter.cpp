@@ -125,6 +125,8 @@ void BasicChapter::start()
 }
 
 void BasicChapter::update(double deltaTime) {
+    // pick up the latest progressive ray trace pass
+    updateTextures(texture);
 
 
     // moving light source, must set it's position...
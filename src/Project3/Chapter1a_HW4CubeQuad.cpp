@@ -214,6 +214,8 @@ void Chapter1a::start()
 }
 
 void Chapter1a::update(double deltaTime) {
+    // pick up the latest progressive ray trace pass
+    updateTextures(texture);
     {
         // do the "normal" drawing
         glViewport(0, 0, scrn_width, scrn_height);
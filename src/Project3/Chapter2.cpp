@@ -23,6 +23,8 @@
 #include <string>
 #include <map>
 #include <filesystem>
+#include <memory>
+#include <chrono>
 
 #include "shader_s.h"
 #include "ImportedModel.h"
@@ -31,6 +33,7 @@
 #include "textures.h"
 #include "SceneGraph.h"
 #include "FrameBufferObjects.h"
+#include "AssetLoader.h"
 
 #include "drawImGui.hpp"
 
@@ -58,10 +61,16 @@ void Chapter2::dragDrop(GLFWwindow* window, int count, const char** paths) {
             else if((temp.find("jpg") != std::string::npos) || (temp.find("png") != std::string::npos))
                 textureFile = temp;
         }        
-        Material *temp = new Material(Shader::shaders["textured"], textureFile, loadTexture(textureFile.c_str()), 4, true);
-        scene.addRenderer(new ObjModel(objFile.c_str(), temp, glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0f, 0.0f)), glm::vec3(1.0f))));
-    }else if (temp.find("obj") != std::string::npos)
-        scene.addRenderer(new ObjModel(paths[0], Material::materials["litMaterial"], glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)), glm::vec3(1.0f))));
+        // everything loads in the background, the window keeps drawing (with a placeholder) meanwhile
+        unsigned int tNum = Texture::acquire(textureFile.c_str(), true);
+        Material *temp = new Material(Shader::shaders["textured"], textureFile, tNum, 4, true);
+        Texture::release(tNum);     // the material holds it now
+        glm::mat4 m = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0f, 0.0f)), glm::vec3(1.0f));
+        scene.addRenderer(new ObjModel(objFile.c_str(), temp, m, true));
+    }else if (temp.find("obj") != std::string::npos) {
+        glm::mat4 m = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)), glm::vec3(1.0f));
+        scene.addRenderer(new ObjModel(paths[0], Material::materials["litMaterial"], m, true));
+    }
 }
 void cubeOfCubes(SceneGraph* sg)
 {
@@ -168,6 +177,11 @@ extern unsigned int scrn_height;
 
 unsigned int texture[] = { 0,1,2,3 };
 
+// CPU time spent handing the scene's passes to GL, averaged over SUBMIT_TIMING_FRAMES frames, shown in the ImGui window
+// (the driver queues the work, so this is the cost of the calls, not of the drawing)
+#define SUBMIT_TIMING_FRAMES 120
+double sceneSubmitMilliseconds = 0.0;
+
 CubeModel* lightCube = NULL;
 SkyboxModel* mySky;
 QuadModel* fQuad;
@@ -183,10 +197,10 @@ void Chapter2::start()
     texMap["sky"] = texture[2];
     texMap["depth"] = setupDepthMap(&depthMapFBO, SHADOW_WIDTH, SHADOW_HEIGHT);
     texMap["offScreen"] = setupFrameBuffer(&offscreenFBO, scrn_width, scrn_height);
-    texMap["shuttle"] = loadTexture("data/spstob_1.jpg");
-    texMap["unicorn"] = loadTexture("data/unicorn.png");
-    texMap["rpi"] = loadTexture("data/rpi.png");
-    texMap["brick"] = loadTexture("data/brick1.jpg");
+    texMap["shuttle"] = Texture::acquire("data/spstob_1.jpg");
+    texMap["unicorn"] = Texture::acquire("data/unicorn.png");
+    texMap["rpi"] = Texture::acquire("data/rpi.png");
+    texMap["brick"] = Texture::acquire("data/brick1.jpg");
 
     // 
     // set up the perspective projection for the camera and the light
@@ -231,6 +245,9 @@ void Chapter2::start()
     }
 
     setupShadersAndMaterials(texMap);
+    // the materials hold the image textures now, they go with the last one using them
+    for (const char* image : { "shuttle", "unicorn", "rpi", "brick" })
+        Texture::release(texMap[image]);
 
     // skybox is special and doesn't belong to the SceneGraph
     mySky = new SkyboxModel(Material::materials["background"], glm::mat4(1.0f)); // our "skybox"
@@ -259,6 +276,8 @@ void Chapter2::start()
 }
 
 void Chapter2::update(double deltaTime) {
+    // pick up the latest progressive ray trace pass
+    updateTextures(texture);
 
     //animate crazy scene stuff
     animateNodes(nodes, scene.time);
@@ -273,6 +292,7 @@ void Chapter2::update(double deltaTime) {
 
     scene.light.position = lightCube->modelMatrix * glm::vec4(0.0, 0.0, 0.0, 1.0);
 
+    auto submitStart = std::chrono::steady_clock::now();
     {
         // first we do the "shadow pass"  really just for creating a depth buffer from the light's perspective
 
@@ -308,6 +328,15 @@ void Chapter2::update(double deltaTime) {
 
         fQuad->render(glm::mat4(1.0f), glm::mat4(1.0f), deltaTime, &scene);
     }
+
+    static double submitTotal = 0.0;
+    static unsigned submitFrames = 0;
+    submitTotal += std::chrono::duration<double>(std::chrono::steady_clock::now() - submitStart).count() * 1000;
+    if (++submitFrames == SUBMIT_TIMING_FRAMES) {
+        sceneSubmitMilliseconds = submitTotal / submitFrames;
+        submitTotal = 0.0;
+        submitFrames = 0;
+    }
     // draw imGui over the top
     drawIMGUI(frontQuad, cubeSystem, &scene, texMap, nodes);
     //scene.time = glfwGetTime();
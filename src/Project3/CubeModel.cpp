@@ -79,19 +79,9 @@ CubeModel::CubeModel(Material* material, glm::mat4 m)
     // vertex buffer object, simple version, just coordinates
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    // position attribute 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // uv attribute
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(3);
+    // position, normal and uv attributes, 8 floats a vertex
+    uploadVertices(vertices, 8, 36, 3, 6);
 
     setupColorAttrib(); // color is in its own VBO
 
@@ -174,9 +164,9 @@ void SkyboxModel::render(glm::mat4 vMat, glm::mat4 pMat, double deltaTime, Scene
     if (myMaterial == NULL)
         myMaterial = Material::materials["green"];
 
-    unsigned int ID = myMaterial->use(sg->renderPass);
+    Shader* shader = myMaterial->use(sg->renderPass);
 
-    myMaterial->myShader->setInt("skybox", 0);
+    shader->setInt(Uniform::skybox, 0);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, myMaterial->textures[0]);
@@ -186,13 +176,13 @@ void SkyboxModel::render(glm::mat4 vMat, glm::mat4 pMat, double deltaTime, Scene
 
     mvp = pMat * vMat;
 
-    glUniformMatrix4fv(glGetUniformLocation(ID, "m"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(ID, "v"), 1, GL_FALSE, glm::value_ptr(glm::mat4(glm::mat3(vMat))));
-    glUniformMatrix4fv(glGetUniformLocation(ID, "p"), 1, GL_FALSE, glm::value_ptr(pMat));
+    shader->setMat4(Uniform::m, modelMatrix);
+    shader->setMat4(Uniform::v, glm::mat4(glm::mat3(vMat)));
+    shader->setMat4(Uniform::p, pMat);
 
-    glUniformMatrix4fv(glGetUniformLocation(ID, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+    shader->setMat4(Uniform::mvp, mvp);
 
-    glUniform1f(glGetUniformLocation(ID, "myTime"), elapsedTime += (float)deltaTime);
+    shader->setFloat(Uniform::myTime, elapsedTime += (float)deltaTime);
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
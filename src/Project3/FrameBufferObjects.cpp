@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "FrameBufferObjects.h"
+#include "TextureResidency.h"
 
 unsigned int setupFrameBuffer(unsigned int* offscreenFBO, unsigned int scrn_width, unsigned int scrn_height) {
     // framebuffer configuration
@@ -30,6 +31,10 @@ unsigned int setupFrameBuffer(unsigned int* offscreenFBO, unsigned int scrn_widt
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, scrn_width, scrn_height); // use a single renderbuffer object for both a depth AND stencil buffer.
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo); // now actually attach it
 
+    // counted against the texture budget, but never cut down
+    trackTexture(textureColorbuffer, GL_TEXTURE_2D);
+    trackRenderbuffer(rbo);
+
     // now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
@@ -53,6 +58,7 @@ unsigned int setupDepthMap(unsigned int* depthMapFBO, unsigned int SHADOW_WIDTH,
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    trackTexture(depthMap, GL_TEXTURE_2D);
     // attach depth texture as FBO's depth buffer
     glBindFramebuffer(GL_FRAMEBUFFER, *depthMapFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
@@ -13,13 +13,29 @@
 #include <cmath>
 #include <vector>
 #include <filesystem>
+#include <chrono>
+#include <memory>
+#include <algorithm>
 
 #include "renderer.h"
 #include "ImportedModel.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
+#include "AssetLoader.h"
+#include "ThreadPool.h"
+#include "textures.h"
+#include "TextureCache.h"
+#include "TextureResidency.h"
 
 using namespace std;
 using namespace glm;
 
+float lodPixelError = 1.0f;
+
+extern unsigned int scrn_height;
+
 ImportedModel::ImportedModel() {}
 
 ImportedModel::ImportedModel(const char* filePath) {
@@ -33,34 +49,146 @@ std::vector<glm::vec3> ImportedModel::getNormals() { return normalVecs; }
 
 // ---------------------------------------------------------------
 
-ModelImporter::ModelImporter() {}
+// everything ObjModel gets from disk, read without GL so it can happen on the asset loader's thread as well
+struct ObjModelData {
+    ObjModel* model = NULL;     /// cleared if the model is deleted before its background load is done
+    std::string filePath;
+    ModelImporter importer;
+    MeshCache cache;
+    std::vector<float> vbovalues;
+    std::vector<unsigned short> shortIndices;
+    bool pack = false;          /// packVertices when the model was created
+    std::vector<PackedVertex> packedVertices;
+    glm::vec3 packedMin, packedExtent;
+
+    // what goes into the buffers, either straight out of the .g4gmesh cache or built from the OBJ
+    const float* vertexData = NULL;
+    unsigned int vertexCount = 0;
+    const void* vertexBytes = NULL;     /// vertexData, or packedVertices when packing
+    size_t vertexSize = 0;
+    const void* indexData = NULL;
+    unsigned int indexCount = 0, indexSize = sizeof(unsigned int);
+    std::vector<objMesh> meshes;
+    std::vector<std::string> materialLibs;
+    std::vector<objLOD> lods;
+    glm::vec3 boundsCenter;
+    float boundsRadius = 0.0f;
+    std::chrono::steady_clock::time_point startTime;
+
+    // background loads only, the materials with their images decoded or block compressed, and how far the upload has got
+    std::vector<mtlRecord> materials;
+    std::map<std::string, unsigned int> imageIndex;     /// mtlRecord::texture to its place in images
+    std::vector<std::string> imagePaths;
+    std::vector<TextureKey> imageKeys;
+    std::vector<unsigned char> imageCached;             /// 1 when the texture cache had the image, so it wasn't decoded
+    bool compressImages = false;                        /// textureCompressionEnabled() when the load was queued
+    std::vector<DecodedImage> images;
+    std::vector<CompressedImage> compressed;            /// the blocks instead of images[i] when they are compressed
+    std::vector<unsigned int> imageTextures;
+    int stage = 0;
+    size_t next = 0;
+    ImageUploadProgress imageProgress;
+    size_t uploaded = 0;
+};
 
-ObjModel::ObjModel(const char* filePath, Material* material, glm::mat4 m)
+// what's left once the mesh is read : the bounding sphere the level of detail is picked with, and the vertices
+// as they go into VBO[0], packed if the model asked for it (the cache always holds them unpacked)
+static void finishObjModel(ObjModelData& data)
 {
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    modelMatrix = m;
+    vec3 min(0.0f), max(0.0f);
+    for (unsigned int v = 0; v < data.vertexCount; v++) {
+        vec3 p = make_vec3(data.vertexData + (size_t)v * 8);
+        min = v == 0 ? p : glm::min(min, p);
+        max = v == 0 ? p : glm::max(max, p);
+    }
+    data.boundsCenter = (min + max) * 0.5f;
+    data.boundsRadius = length(max - min) * 0.5f;
 
-    myMaterial = material;
+    if (data.pack) {
+        packVertexData(data.vertexData, 8, data.vertexCount, 3, 6, data.packedVertices, data.packedMin, data.packedExtent);
+        data.vertexBytes = data.packedVertices.data();
+        data.vertexSize = data.packedVertices.size() * sizeof(PackedVertex);
+    }
+    else {
+        data.vertexBytes = data.vertexData;
+        data.vertexSize = (size_t)data.vertexCount * 8 * sizeof(float);
+    }
+}
 
-    glGenVertexArrays(1, &VAO);
-    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-    glBindVertexArray(VAO);
+// the full mesh as lods[0] and coarser ones after it, each simplified from the one before until LOD_MAX_LEVELS
+// or until it hardly gets smaller, their indices are appended to indices
+static void buildObjLODs(const char* name, const float* vertices, unsigned int vertexCount, std::vector<unsigned int>& indices,
+    const std::vector<size_t>& starts, std::vector<objLOD>& lods)
+{
+    auto startTime = std::chrono::steady_clock::now();
 
-    glGenBuffers(numVBOs = 2, VBO);
-    glGenBuffers(1, &EBO);
+    lods.clear();
+    lods.push_back({ 0, (unsigned int)indices.size(), 0.0f, std::vector<unsigned int>(starts.begin(), starts.end()) });
+
+    std::vector<unsigned int> level(indices), simplified;
+    std::vector<size_t> levelStarts(starts), simplifiedStarts;
+    float error = 0.0f;
+
+    while (lods.size() < LOD_MAX_LEVELS) {
+        // each level is simplified from the last one, so its error is at most the sum of theirs
+        error += simplifyMesh(vertices, 8, vertexCount, level.data(), level.size(), levelStarts,
+            (size_t)(level.size() * LOD_REDUCTION), simplified, simplifiedStarts);
+        if (simplified.empty() || simplified.size() > level.size() * 9 / 10)
+            break;
+
+        optimizeTriangleOrder(vertices, 8, vertexCount, simplified.data(), simplified.size(), simplifiedStarts);
+
+        lods.push_back({ (unsigned int)indices.size(), (unsigned int)simplified.size(), error,
+            std::vector<unsigned int>(simplifiedStarts.begin(), simplifiedStarts.end()) });
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        level.swap(simplified);
+        levelStarts.swap(simplifiedStarts);
+    }
+
+    if (!importerVerbose)
+        return;
+    std::cout << name << " : " << lods.size() << " levels of detail (";
+    for (size_t i = 0; i < lods.size(); i++)
+        std::cout << (i ? ", " : "") << lods[i].indexCount / 3;
+    std::cout << " triangles, error " << error << ") in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * 1000 << " ms\n";
+}
+
+// the mesh, from the cache if it is up to date, otherwise parsed (and the cache written for next time)
+static void readObjModel(ObjModelData& data)
+{
+    const char* filePath = data.filePath.c_str();
+    ModelImporter& modelImporter = data.importer;
+
+    data.startTime = std::chrono::steady_clock::now();
+
+    if (data.cache.load(filePath)) {
+        data.vertexData = data.cache.vertices;
+        data.vertexCount = data.cache.vertexCount;
+        data.indexData = data.cache.indices;
+        data.indexCount = data.cache.indexCount;
+        data.indexSize = data.cache.indexSize;
+        data.meshes = data.cache.meshes;
+        data.materialLibs = data.cache.materialLibs;
+        data.lods = data.cache.lods;
+        finishObjModel(data);
+        return;
+    }
 
-    ModelImporter modelImporter = ModelImporter();
-    Renderer::name = filePath;
     modelImporter.parseOBJ(filePath);
 
-    const std::vector<vec3>& verts = modelImporter.getVertices();
-    const std::vector<vec2>& tcs = modelImporter.getTextureCoordinates();
-    const std::vector<vec3>& normals = modelImporter.getNormals();
+    // one vertex per distinct (position, texture coordinate, normal) corner instead of one per corner
+    modelImporter.buildIndexedMesh();
+    modelImporter.releaseCorners();
 
-    std::vector<float> vbovalues;
-    std::vector<int> indices;
+    const std::vector<vec3>& verts = modelImporter.getIndexedVertices();
+    const std::vector<vec2>& tcs = modelImporter.getIndexedTextureCoordinates();
+    const std::vector<vec3>& normals = modelImporter.getIndexedNormals();
+    std::vector<unsigned int>& indices = modelImporter.getIndices();
 
-    for (int i = 0; i < modelImporter.getNumVertices(); i++) {
+    std::vector<float>& vbovalues = data.vbovalues;
+    vbovalues.reserve(verts.size() * 8);
+    for (size_t i = 0; i < verts.size(); i++) {
         vbovalues.push_back(verts[i].x);
         vbovalues.push_back(verts[i].y);
         vbovalues.push_back(verts[i].z);
@@ -71,20 +199,195 @@ ObjModel::ObjModel(const char* filePath, Material* material, glm::mat4 m)
 
         vbovalues.push_back(tcs[i].x);
         vbovalues.push_back(tcs[i].y);
+    }
+
+    data.meshes = modelImporter.getMeshes();
+    data.materialLibs = modelImporter.getMaterialLibraries();
+
+    data.vertexData = vbovalues.data();
+    data.vertexCount = (unsigned int)verts.size();
+
+    // triangles in vertex cache order and vertices in the order they are used, the cache keeps the result
+    std::vector<size_t> starts;
+    for (const objMesh& mesh : data.meshes)
+        starts.push_back(mesh.startingVert);
+    optimizeMesh(filePath, vbovalues.data(), 8, data.vertexCount, indices.data(), indices.size(), starts);
+
+    // the coarser levels go after the full mesh in the same indices
+    buildObjLODs(filePath, vbovalues.data(), data.vertexCount, indices, starts, data.lods);
+    data.indexCount = indices.size();
+
+    if (data.vertexCount <= 65536) {
+        // every index fits in 16 bits, half the index memory and bandwidth
+        data.shortIndices.assign(indices.begin(), indices.end());
+        data.indexSize = sizeof(unsigned short);
+        data.indexData = data.shortIndices.data();
+    }
+    else {
+        data.indexSize = sizeof(unsigned int);
+        data.indexData = indices.data();
+    }
+
+    if (MeshCache::write(filePath, data.vertexData, data.vertexCount, data.indexData, data.indexCount, data.indexSize, data.meshes, data.materialLibs, data.lods))
+        std::cout << "wrote " << MeshCache::pathFor(filePath) << "\n";
+    else
+        std::cout << "couldn't write " << MeshCache::pathFor(filePath) << ", the next launch parses " << filePath << " again\n";
+
+    finishObjModel(data);
+}
+
+// the MTL files and the images they name, read like loadTextures() does : from their .g4gtex caches, or decoded
+// across the shared pool and then block compressed and cached
+static void readObjMaterials(ObjModelData& data)
+{
+    for (const std::string& mtl : data.materialLibs)
+        ModelImporter::readMTL(mtl.c_str(), data.materials);
+
+    std::vector<std::string>& paths = data.imagePaths;
+    for (const mtlRecord& mtl : data.materials)
+        if (!mtl.texture.empty() && data.imageIndex.find(mtl.texture) == data.imageIndex.end()) {
+            data.imageIndex[mtl.texture] = (unsigned int)paths.size();
+            paths.push_back(mtl.texturePath);
+        }
+
+    // images the texture cache already has aren't decoded again
+    data.imageKeys.resize(paths.size());
+    data.imageCached.assign(paths.size(), 0);
+    data.images.resize(paths.size());
+    data.compressed.resize(paths.size());
+    ThreadPool::shared().parallelFor((unsigned)paths.size(), [&](unsigned i) {
+        textureKey(paths[i].c_str(), data.imageKeys[i]);
+        data.imageCached[i] = Texture::find(data.imageKeys[i]) != 0;
+    });
+
+    std::vector<std::string> readPaths;
+    std::vector<unsigned int> read;
+    for (unsigned int i = 0; i < paths.size(); i++)
+        if (!data.imageCached[i]) {
+            readPaths.push_back(paths[i]);
+            read.push_back(i);
+        }
+    if (read.empty())
+        return;
+
+    std::vector<DecodedImage> images(read.size());
+    std::vector<CompressedImage> compressed(read.size());
+    unsigned int fromCache, encoded;
+    readTextureImages(readPaths.data(), (unsigned int)read.size(), data.compressImages, images.data(), compressed.data(), fromCache, encoded);
+    for (size_t r = 0; r < read.size(); r++) {
+        data.images[read[r]] = images[r];
+        data.compressed[read[r]] = std::move(compressed[r]);
+    }
+    if (data.compressImages)
+        std::cout << fromCache << " of " << read.size() << (read.size() == 1 ? " texture" : " textures") << " from caches, " << encoded << " block compressed\n";
+}
+
+// an image that wouldn't load (tNum 0) leaves its material untextured
+static void createMaterial(const mtlRecord& mtl, unsigned int tNum)
+{
+    if (mtl.texture.empty() || tNum == 0)
+        new Material(Shader::shaders["PhongShadowed"], mtl.name, -1, mtl.color);
+    else
+        new Material(Shader::shaders["textured"], mtl.name, tNum, 4, true);
+}
+
+// hands the next slice of bytes to the buffer bound to target, true once all of them are there
+static bool uploadBufferSlice(unsigned int target, const void* bytes, size_t size, size_t& uploaded)
+{
+    if (uploaded == 0)
+        glBufferData(target, size, NULL, GL_STATIC_DRAW);
+
+    size_t slice = std::min((size_t)ASSET_UPLOAD_SLICE, size - uploaded);
+    glBufferSubData(target, uploaded, slice, (const char*)bytes + uploaded);
+    uploaded += slice;
+    return uploaded == size;
+}
+
+ObjModel::ObjModel(const char* filePath, Material* material, glm::mat4 m, bool background)
+{
+    // set up vertex data (and buffer(s)) and configure vertex attributes
+    modelMatrix = m;
+
+    myMaterial = material;
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(numVBOs = 2, VBO);
+    glGenBuffers(1, &EBO);
 
-        indices.push_back(i);
+    Renderer::name = filePath;
+    this->filePath = filePath;
+
+    if (background) {
+        // a placeholder is drawn until uploadSlice() says the model is ready
+        ready = false;
+        loading = std::make_shared<ObjModelData>();
+        loading->model = this;
+        loading->filePath = filePath;
+        loading->pack = packVertices;
+        loading->compressImages = textureCompressionEnabled();
+
+        std::shared_ptr<ObjModelData> data = loading;
+        loadInBackground(
+            [data]() {
+                readObjModel(*data);
+                readObjMaterials(*data);
+            },
+            [data]() { return data->model == NULL || data->model->uploadSlice(); });
+        return;
     }
 
-    for (objMesh temp : modelImporter.getMeshes())
-        meshes.push_back(temp);
+    ObjModelData data;
+    data.filePath = filePath;
+    data.pack = packVertices;
+    readObjModel(data);
 
-    indexCount = indices.size();
+    for (const std::string& mtl : data.materialLibs)
+        data.importer.parseMTL(mtl.c_str());
+
+    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
+    glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, vbovalues.size() * 4, &vbovalues[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, data.vertexSize, data.vertexBytes, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * 4, &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)data.indexCount * data.indexSize, data.indexData, GL_STATIC_DRAW);
+
+    setupVertexAttribs(data);
+
+    glBindVertexArray(0);
+};
+
+ObjModel::~ObjModel()
+{
+    // a background load that is still going drops its results when it sees this
+    if (loading)
+        loading->model = NULL;
+}
+
+// with the VAO and both buffers bound, and the buffers filled
+void ObjModel::setupVertexAttribs(ObjModelData& data)
+{
+    indexSize = data.indexSize;
+    meshes = data.meshes;
+    lods = data.lods;
+    lod = 0;
+    boundsCenter = data.boundsCenter;
+    boundsRadius = data.boundsRadius;
+    indexCount = lods[0].indexCount;
+
+    if (importerVerbose)
+        std::cout << data.filePath << " : " << data.vertexCount << " vertices (" << data.vertexSize / 1024 << (data.pack ? " KB packed) for " : " KB) for ")
+            << indexCount << " corners in " << lods.size() << " levels of detail, " << indexSize * 8 << " bit indices, " << (data.cache.vertices ? "from the cache" : "parsed") << " in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - data.startTime).count() * 1000 << " ms\n";
+
+    if (data.pack) {
+        packedMin = data.packedMin;
+        packedExtent = data.packedExtent;
+        setupPackedAttribs();
+        setupColorAttrib();
+        return;
+    }
 
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -101,17 +404,161 @@ ObjModel::ObjModel(const char* filePath, Material* material, glm::mat4 m)
     glEnableVertexAttribArray(3);
 
     setupColorAttrib();
+}
 
+// the render thread's part of a background load : materials, then textures, then the two buffers,
+// a slice at a time until the frame's upload budget is spent, true once the model is ready to draw
+bool ObjModel::uploadSlice()
+{
+    ObjModelData& data = *loading;
+
+    glBindVertexArray(VAO);
+    do {
+        if (data.stage == 0) {
+            data.imageTextures.resize(data.images.size());
+            for (size_t i = 0; i < data.images.size(); i++) {
+                unsigned int& tNum = data.imageTextures[i];
+                if ((tNum = Texture::share(data.imageKeys[i]))) {
+                    // cached, nothing to upload
+                    freeImage(data.images[i]);
+                    freeCompressed(data.compressed[i]);
+                    continue;
+                }
+                if (data.imageCached[i]) {
+                    // it was cached when the loader thread looked, but it's gone since, so it loads on its own
+                    tNum = loadTextureAsync(data.imagePaths[i].c_str());
+                    Texture::adopt(data.imageKeys[i], tNum);
+                }
+                else if (data.images[i].pixels || !data.compressed[i].levels.empty()) {
+                    glGenTextures(1, &tNum);
+                    Texture::adopt(data.imageKeys[i], tNum);
+                }
+                // else it wouldn't decode, and won't any better here
+            }
+
+            for (const mtlRecord& mtl : data.materials)
+                createMaterial(mtl, mtl.texture.empty() ? 0 : data.imageTextures[data.imageIndex[mtl.texture]]);
+            // the materials hold the textures now
+            for (unsigned int tNum : data.imageTextures)
+                if (tNum)
+                    Texture::release(tNum);
+            data.stage++;
+        }
+        else if (data.stage == 1) {
+            if (data.next == data.images.size()) {
+                data.stage++;
+            }
+            else if (uploadImageSlice(data.imageTextures[data.next], data.images[data.next], data.compressed[data.next], data.imageProgress)) {
+                // a cached one was never uploaded here, it's tracked already
+                if (data.images[data.next].pixels || !data.compressed[data.next].levels.empty())
+                    trackTexture(data.imageTextures[data.next], GL_TEXTURE_2D, data.imagePaths[data.next].c_str());
+                freeImage(data.images[data.next]);
+                freeCompressed(data.compressed[data.next]);
+                data.next++;
+                data.imageProgress = ImageUploadProgress();
+            }
+        }
+        else if (data.stage == 2) {
+            glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+            if (uploadBufferSlice(GL_ARRAY_BUFFER, data.vertexBytes, data.vertexSize, data.uploaded)) {
+                data.uploaded = 0;
+                data.stage++;
+            }
+        }
+        else if (data.stage == 3) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            if (uploadBufferSlice(GL_ELEMENT_ARRAY_BUFFER, data.indexData, (size_t)data.indexCount * data.indexSize, data.uploaded)) {
+                glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+                setupVertexAttribs(data);
+                ready = true;
+            }
+        }
+    } while (!ready && assetTimeLeft());
     glBindVertexArray(0);
-};
+
+    if (ready)
+        loading.reset();
+    return ready;
+}
+
+// drawn in place of a model that is still loading, a slowly turning cube
+void ObjModel::renderPlaceholder(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, SceneGraph* sg)
+{
+    static CubeModel* placeholder = NULL;
+
+    if (placeholder == NULL) {
+        placeholder = new CubeModel(Material::materials["green"], glm::mat4(1.0f));
+        // it belongs to no scene, keep it out of the renderer list as well
+        Renderer::renderList.erase(std::find(Renderer::renderList.begin(), Renderer::renderList.end(), placeholder));
+    }
+
+    placeholder->modelMatrix = glm::rotate(modelMatrix, elapsedTime += (float)deltaTime, glm::vec3(0.0f, 1.0f, 0.0f));
+    placeholder->render(treeMat, vpMat, deltaTime, sg);
+}
+
+RayScene* rayTraceScene(const float* vertices, unsigned floatsPerVertex, const void* indices, unsigned indexSize, unsigned indexCount,
+    const float* modelMatrix, const float* eye, const float* target, float fov);
+
+void ObjModel::rayTrace(glm::vec3 eye, glm::vec3 target, float fov)
+{
+    std::shared_ptr<RayScene*> traced = std::make_shared<RayScene*>((RayScene*)NULL);
+    std::string path = filePath;
+    glm::mat4 m = modelMatrix;
+
+    loadInBackground(
+        [=]() {
+            // the model was read just now, so this is the cache (or a parse if it couldn't be written)
+            ObjModelData data;
+            data.filePath = path;
+            readObjModel(data);
+            if (!data.lods.empty())
+                *traced = rayTraceScene(data.vertexData, 8, data.indexData, data.indexSize, data.lods[0].indexCount,
+                    glm::value_ptr(m), glm::value_ptr(eye), glm::value_ptr(target), fov);
+        },
+        [=]() {
+            if (*traced)
+                showInRayTraceTexture(*traced);
+            return true;
+        });
+}
+
+unsigned int ObjModel::indexType() { return indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+// the coarsest level whose error stays under lodPixelError pixels on screen, from the camera's point of view
+// (the shadow pass keeps what the camera picked), a level only gets coarser once it is well under so it doesn't
+// flicker back and forth when the distance hovers around a switch
+unsigned int ObjModel::selectLOD(glm::mat4 treeMat, SceneGraph* sg)
+{
+    if (lods.size() < 2 || sg->renderPass != SceneGraph::REGULAR)
+        return lod;
+
+    glm::mat4 toWorld = treeMat * modelMatrix;
+    float scale = std::max(glm::length(glm::vec3(toWorld[0])), std::max(glm::length(glm::vec3(toWorld[1])), glm::length(glm::vec3(toWorld[2]))));
+    glm::vec3 center = glm::vec3(toWorld * glm::vec4(boundsCenter, 1.0f));
+    float distance = std::max(glm::length(center - sg->camera.position) - boundsRadius * scale, 1e-3f);
+
+    // pixels one of the model's units covers at that distance
+    float pixels = scale * sg->camera.projection()[1][1] * scrn_height * 0.5f / distance;
+
+    while (lod > 0 && lods[lod].error * pixels > lodPixelError)
+        lod--;
+    while (lod + 1 < lods.size() && lods[lod + 1].error * pixels < lodPixelError * (1.0f - LOD_HYSTERESIS))
+        lod++;
+    return lod;
+}
 
 void ObjModel::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, SceneGraph* sg) {
 
     glm::mat4 mvp;
-    unsigned int shaderID;
+    Shader* shader;
 
     if (!enabled) return;
 
+    if (!ready) {
+        renderPlaceholder(treeMat, vpMat, deltaTime, sg);
+        return;
+    }
+
     //assert(myMaterial != NULL);
 
     if (myMaterial == NULL)
@@ -120,24 +567,25 @@ void ObjModel::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
     glm::vec3 lightLoc = sg->light.position;
     glm::vec3 cameraLoc = sg->camera.position;
 
-    shaderID = myMaterial->use(sg->renderPass);
+    shader = myMaterial->use(sg->renderPass);
 
-    glUniform1f(glGetUniformLocation(shaderID, "myTime"), elapsedTime += (float)deltaTime);
+    shader->setFloat(Uniform::myTime, elapsedTime += (float)deltaTime);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "m"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "v"), 1, GL_FALSE, glm::value_ptr(treeMat));
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "p"), 1, GL_FALSE, glm::value_ptr(vpMat));
+    shader->setMat4(Uniform::m, modelMatrix);
+    shader->setMat4(Uniform::v, treeMat);
+    shader->setMat4(Uniform::p, vpMat);
 
     // because it is only once per model, another approach might be just to pre-multiply model, view and perspective 
     mvp = vpMat * treeMat * modelMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+    shader->setMat4(Uniform::mvp, mvp);
 
-    glUniform3fv(glGetUniformLocation(shaderID, "cPos"), 1, glm::value_ptr(cameraLoc));
-    glUniform3fv(glGetUniformLocation(shaderID, "lPos"), 1, glm::value_ptr(lightLoc));
+    shader->setVec3(Uniform::cPos, cameraLoc);
+    shader->setVec3(Uniform::lPos, lightLoc);
 
     glm::mat4 lightViewProjection = sg->light.projection() * glm::lookAt(sg->light.position, sg->light.target, sg->light.up);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightViewProjection));
+    shader->setMat4(Uniform::lightSpaceMatrix, lightViewProjection);
+    setPackingUniforms(shader);
 
     glBindVertexArray(VAO);
 
@@ -147,14 +595,19 @@ void ObjModel::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    const objLOD& level = lods[selectLOD(treeMat, sg)];
+
     if (meshes.size() == 0) {
-        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instances);
+        if (instances > 0)
+            myMaterial->drawn(shader);
+        glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, indexType(), (void*)(level.firstIndex * (size_t)indexSize), instances);
     } else {
         for (int i = 0; i < meshes.size(); i++) {
 
-            unsigned int shaderID;
+            Shader* shader;
 
-            shaderID = Material::materials[meshes[i].myName]->use(sg->renderPass);
+            Material* material = Material::materials[meshes[i].myName];
+            shader = material->use(sg->renderPass);
 
             glm::mat4 mvp;
 
@@ -163,22 +616,23 @@ void ObjModel::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
             glm::vec3 lightLoc = sg->light.position;
             glm::vec3 cameraLoc = sg->camera.position;
 
-            glUniform1f(glGetUniformLocation(shaderID, "myTime"), elapsedTime += (float)deltaTime);
+            shader->setFloat(Uniform::myTime, elapsedTime += (float)deltaTime);
 
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "m"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "v"), 1, GL_FALSE, glm::value_ptr(treeMat));
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "p"), 1, GL_FALSE, glm::value_ptr(vpMat));
+            shader->setMat4(Uniform::m, modelMatrix);
+            shader->setMat4(Uniform::v, treeMat);
+            shader->setMat4(Uniform::p, vpMat);
 
             // because it is only once per model, another approach might be just to pre-multiply model, view and perspective 
             mvp = vpMat * treeMat * modelMatrix;
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+            shader->setMat4(Uniform::mvp, mvp);
 
-            glUniform3fv(glGetUniformLocation(shaderID, "cPos"), 1, glm::value_ptr(cameraLoc));
-            glUniform3fv(glGetUniformLocation(shaderID, "lPos"), 1, glm::value_ptr(lightLoc));
+            shader->setVec3(Uniform::cPos, cameraLoc);
+            shader->setVec3(Uniform::lPos, lightLoc);
 
             glm::mat4 lightViewProjection = sg->light.projection() * glm::lookAt(sg->light.position, sg->light.target, sg->light.up);
 
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightViewProjection));
+            shader->setMat4(Uniform::lightSpaceMatrix, lightViewProjection);
+            setPackingUniforms(shader);
 
             glBindVertexArray(VAO);
 
@@ -186,240 +640,36 @@ void ObjModel::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
             glCullFace(GL_BACK);
             glFrontFace(GL_CCW);
 
-            unsigned int endingVert = indexCount;
+            unsigned int endingVert = level.indexCount;
 
             if ((i+1) < meshes.size())
-                endingVert = meshes[i + 1].startingVert;
+                endingVert = level.starts[i + 1];
 
-            glDrawElementsInstanced(GL_TRIANGLES, endingVert - meshes[i].startingVert, GL_UNSIGNED_INT, (void*)(meshes[i].startingVert * sizeof(unsigned int)), instances);
-        }
-    }
-}
+            if (instances > 0 && endingVert > level.starts[i])
+                material->drawn(shader);
 
-#include "textures.h"
-
-using std::string;
-
-static string getPathName(const string& s) {
-
-   char sep = '/';
-
-   size_t i = s.rfind(sep, s.length());
-   if (i != string::npos) {
-      return(s.substr(0, i) + "/");
-   }
-
-   sep = '\\';
-
-   i = s.rfind(sep, s.length());
-   if (i != string::npos) {
-       return(s.substr(0, i) + "/");
-   }
-
-   return("");
-}
-
-void ModelImporter::parseMTL(const char* filePath) {
-    int count = 0;
-    ifstream fileStream(filePath, ios::in);
-    string line = "";
-    bool activeMtl = false;
-    string mtlName;
-    string attrib,val;
-    unsigned int tNum = 0;
-    bool textured = false;
-    glm::vec4 mtlColor;
-
-    if (fileStream.good()) {
-        std::cout << "loading material descriptions from " << filePath << "\n";
-        while (!fileStream.eof()) {
-            getline(fileStream, line);
-            std::istringstream nStream;
-            nStream.clear();
-            nStream.str(line);
-            nStream >> attrib;
-
-            if (attrib == "newmtl"){
-                if (activeMtl) {
-                    if (textured)
-                        new Material(Shader::shaders["textured"], mtlName, tNum, 4, true);
-                    else
-                        new Material(Shader::shaders["PhongShadowed"], mtlName, -1, mtlColor);
-                }
-                nStream >> mtlName;
-                activeMtl = true;
-                textured = false;
-            }else {
-                if ((attrib == "map_Kd") || (attrib == "map_Ka")){
-                    nStream >> val;
-                    if (val.compare( 0, 1, "-") == 0) {
-                        nStream >> val;
-                        nStream >> val;
-                    }
-                    string tName = getPathName(filePath) + val;
-
-                    if (textures[val] == NULL) {
-                        std::cout << "loading " << attrib << " texture : " << tName << "\n";
-                        tNum = loadTexture(tName.c_str());
-                        textures[val] = tNum;
-                    }
-                    else {
-                        std::cout << "already loaded " << attrib << " texture : " << tName << "\n";
-                        tNum = textures[val];
-                    }
-                    textured = true;
-                }else if (attrib == "Kd") {
-                    float r, g, b;
-                    nStream >> r >> g >> b;
-                    mtlColor = glm::vec4(r,g,b,1.0);
-                }
-            }
+            glDrawElementsInstanced(GL_TRIANGLES, endingVert - level.starts[i], indexType(), (void*)((level.firstIndex + level.starts[i]) * (size_t)indexSize), instances);
         }
-        if (textured)
-            new Material(Shader::shaders["textured"], mtlName, tNum, 4, true);
-        else
-            new Material(Shader::shaders["PhongShadowed"], mtlName, -1, mtlColor);
     }
 }
 
-void ModelImporter::parseOBJ(const char* filePath) {
-    float x, y, z;
-    string content;
-    ifstream fileStream(filePath, ios::in);
-    string line = "";
-
-    string lType;
-    std::istringstream objStream(line);
-    vec3 cNormal;
-
-    while (!fileStream.eof()) {
-        getline(fileStream, line);
-        objStream.clear();
-        objStream.str(line);
-
-        objStream >> lType;
-
-        if (objStream.fail())
-            continue;
-
-        if (lType == "v") { // vertex coordinates
-            objStream >> x >> y >> z;
-            vertVals.push_back(vec3(x,y,z));
-            continue;
-        }else if (lType == "vt") { // texture coordinates
-            objStream >>  x >> y;
-            stVals.push_back(vec2(x,y));
-            continue;
-        }else if (lType == "vn") { // vertex normals
-            objStream >> x >> y >> z;
-            normVals.push_back(vec3(x,y,z));
-            continue;
-        }else if (lType == "f") { // faces
-            string oneCorner;
-            std::vector<vertIndices> viList;
-
-            for (int i = 0; i < 4; i++) {
-                objStream >> oneCorner;
-                if (objStream.fail())
-                    break;
-
-                vertIndices temp;
-
-                temp.ti = temp.ni = temp.vi = 0;
-                
-                // parse each face's indices
-                if (sscanf(oneCorner.c_str(), "%i/%i/%i", &temp.vi, &temp.ti, &temp.ni) != 3) {
-                    temp.ti = temp.ni = temp.vi = 0;
-                    if (sscanf(oneCorner.c_str(), "%i//%i", &temp.vi, &temp.ni) != 2) {
-                        temp.ti = temp.ni = temp.vi = 0;
-                        if (sscanf(oneCorner.c_str(), "%i/%i", &temp.vi, &temp.ti) != 2){
-                            temp.ti = temp.ni = temp.vi = 0;
-                            if (sscanf(oneCorner.c_str(), "%i", &temp.vi) != 1)
-                                std::cout << "unimplemented face format\n";
-                        }
-                    }
-                }
-                // account for relative indexing, adjust by number of preceding attributes
-                if (temp.vi < 0) temp.vi += vertVals.size() + 1;
-                if (temp.ni < 0) temp.ni += normVals.size() + 1;
-                if (temp.ti < 0) temp.ti += stVals.size() + 1;
-
-                viList.push_back(temp);
-
-                if (i > 2) { 
-                    // if more than 3 verts in face, it's a quad, so re-emit 2 verts to cause a tri
-                    viList.push_back(viList[viList.size() - 4]);
-                    viList.push_back(viList[viList.size() - 3]);
-                }
-            }
-
-            if (viList[0].ni == 0) {
-                // if no normal, calculate a face formal from face edges
-                vec3 ab, bc;
-
-                ab = vertVals[viList[2].vi - 1] - vertVals[viList[1].vi - 1];
-                bc = vertVals[viList[0].vi - 1] - vertVals[viList[1].vi - 1];
-
-                cNormal = cross(ab, bc);
-            }
-            else
-                cNormal = vec3(0);
-
-            for (vertIndices temp : viList) {
-                int vertRef = temp.vi;
-                int tcRef = temp.ti;
-                int normRef = temp.ni;
-
-                // references start at 1, not 0, so adjust
-                vertRef--;
-                tcRef--;
-                normRef--;
-
-                if (vertRef > -1) {
-                    triangleVerts.push_back(vertVals[vertRef]);
-                }
-                else {
-                    triangleVerts.push_back(vec3(0.0f));
-                }
-
-                if (tcRef > -1) {
-                    textureCoords.push_back(stVals[tcRef]);
-                }
-                else {
-                    textureCoords.push_back(vec2(0.0f));
-                }
-
-                if (normRef > -1) {
-                    normals.push_back(normVals[normRef]);
-                }
-                else {
-                    normals.push_back(cNormal);
-                }
-            }
-            continue;
-        }else if (lType == "mtllib") { // uses a material library file
-            string fname;
-            objStream >> fname;
-            fname = getPathName(filePath) + fname;
-            parseMTL(fname.c_str());
-            continue;
-        }
-        else if (lType == "usemtl") { // use this material on the next faces, unitl next material
-            objMesh temp;
-            objStream >> temp.myName;
-
-            if (meshes.empty() || (temp.myName != meshes.back().myName)) // only create mesh when there is a material change
-            {
-                std::cout << temp.myName << " " << getNumVertices() << "\n";
-                temp.startingVert = getNumVertices();
-                meshes.push_back(temp);
-            }
-            continue;
-        }
-    }
+void ModelImporter::parseMTL(const char* filePath) {
+    std::vector<mtlRecord> records;
+    readMTL(filePath, records);
+
+    // the texture cache shares the images between materials, and with every other model,
+    // the ones it doesn't have yet are decoded all together
+    std::vector<std::string> paths;
+    for (const mtlRecord& mtl : records)
+        if (!mtl.texture.empty())
+            paths.push_back(mtl.texturePath);
+    std::vector<unsigned int> textures;
+    Texture::acquire(paths, textures);
+
+    size_t next = 0;
+    for (const mtlRecord& mtl : records)
+        createMaterial(mtl, mtl.texture.empty() ? 0 : textures[next++]);
+    // the materials hold them now
+    for (unsigned int tNum : textures)
+        Texture::release(tNum);
 }
-int ModelImporter::getNumVertices() { return (triangleVerts.size()); }
-std::vector<vec3> ModelImporter::getVertices() { return triangleVerts; }
-std::vector<vec2> ModelImporter::getTextureCoordinates() { return textureCoords; }
-std::vector<vec3> ModelImporter::getNormals() { return normals; }
-std::vector<objMesh> ModelImporter::getMeshes() { return meshes; }
@@ -1,6 +1,24 @@
+#pragma once
+
 #include <vector>
+#include <string>
+#include <map>
+
+#include <glm/glm.hpp>
 
-struct objMesh;
+// a run of faces sharing one material, from startingVert up to the next mesh
+struct objMesh {
+    std::string myName;
+    int startingVert;
+};
+
+// one level of detail in an ObjModel's index buffer, the levels share the vertices and follow each other
+// submesh i of the level starts at firstIndex + starts[i]
+struct objLOD {
+    unsigned int firstIndex, indexCount;
+    float error;                        /// how far it strays from the full mesh, in the model's units
+    std::vector<unsigned int> starts;   /// one per objMesh
+};
 
 class ImportedModel
 {
@@ -18,6 +36,18 @@ public:
 	std::vector<glm::vec3> getNormals();
 };
 
+// one newmtl from an MTL file, what parseMTL() turns into a Material
+struct mtlRecord {
+	std::string name;
+	std::string texture;        /// map_Kd (or map_Ka) as written in the file, empty when untextured
+	std::string texturePath;    /// the same relative to the working directory
+	glm::vec4 color = glm::vec4(1.0f);   /// Kd
+};
+
+// timings and sizes of every model load on stdout, off in the sandbox, objbench -v turns it on
+// (damaged files are reported either way, one line per kind of damage)
+extern bool importerVerbose;
+
 struct vertIndices {
 	int vi, ti, ni;
 };
@@ -32,15 +62,47 @@ private:
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec3> normVals;
 	std::vector<objMesh> meshes;
-	std::map<std::string, unsigned int> textures;
-	std::vector<vertIndices> vertIndexList;
+	std::vector<vertIndices> vertIndexList;   /// (vi, ti, ni) of every triangle corner, one without a normal gets ni = -1 - its face's first corner
+	std::vector<std::string> materialLibs;
+	std::vector<glm::vec3> uniqueVerts;
+	std::vector<glm::vec2> uniqueTexCoords;
+	std::vector<glm::vec3> uniqueNormals;
+	std::vector<unsigned int> indices;
+
+	void corner(size_t i, glm::vec3& position, glm::vec2& texCoord, glm::vec3& normal) const;
+	void expandCorners();
 public:
 	ModelImporter();
-	void parseOBJ(const char* filePath);
+	// threads == 0 spreads big files over every core, threads == 1 stays on the calling thread
+	// either way the result is the same
+	void parseOBJ(const char* filePath, unsigned threads = 0);
+	// creates a Material (and loads its texture) for every material in the file, needs the GL context
 	void parseMTL(const char* filePath);
+	// only reads the file, safe on any thread
+	static void readMTL(const char* filePath, std::vector<mtlRecord>& records);
+	// number of triangle corners, 3 per triangle
 	int getNumVertices();
-	std::vector<glm::vec3> getVertices();
-	std::vector<glm::vec2> getTextureCoordinates();
-	std::vector<glm::vec3> getNormals();
-	std::vector<objMesh> getMeshes();
+	// one entry per triangle corner, built the first time one of them is asked for (the indexed mesh doesn't need them)
+	const std::vector<glm::vec3>& getVertices();
+	const std::vector<glm::vec2>& getTextureCoordinates();
+	const std::vector<glm::vec3>& getNormals();
+	const std::vector<objMesh>& getMeshes() const;
+	// mtllib files named by the OBJ, parseOBJ() only collects them, pass each to parseMTL() to create the Materials
+	const std::vector<std::string>& getMaterialLibraries() const;
+
+	// after parseOBJ(), turns the corners into an indexed mesh, corners with the same (vi, ti, ni) share one vertex
+	// (a corner without a normal only shares within its face, it gets that face's normal)
+	// the indices follow the corners, so objMesh::startingVert is an index offset as well
+	void buildIndexedMesh();
+	const std::vector<glm::vec3>& getIndexedVertices() const;
+	const std::vector<glm::vec2>& getIndexedTextureCoordinates() const;
+	const std::vector<glm::vec3>& getIndexedNormals() const;
+	const std::vector<unsigned int>& getIndices() const;
+	// the triangles may be reordered in place, they only have to stay within their objMesh (see MeshOptimizer.h)
+	std::vector<unsigned int>& getIndices();
+	// frees what parseOBJ() kept per attribute and per corner, for when only the indexed mesh is wanted
+	// getNumVertices() and getVertices() and friends are empty afterwards
+	void releaseCorners();
+
+	static std::string getPathName(const std::string& s);
 };
\ No newline at end of file
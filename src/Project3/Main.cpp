@@ -31,6 +31,7 @@
 #include "textures.h"
 #include "SceneGraph.h"
 #include "FrameBufferObjects.h"
+#include "AssetLoader.h"
 
 #include "drawImGui.hpp"
 
@@ -145,11 +146,18 @@ int main()
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // upload a little more of whatever is loading in the background, models and the textures the
+        // budget brings back (every chapter's updateTextures() can queue those)
+        updateAssetLoader();
+
         myDemo.update(deltaTime);
 
         glfwSwapBuffers(window);
     }
 
+    // the loader thread goes before the GL context does, whatever it hasn't uploaded is dropped
+    stopAssetLoader();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
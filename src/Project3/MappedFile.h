@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// a whole file mapped read only into memory, so big models are scanned in place instead of copied
+// through a stream, data() is NOT null terminated, stop at data() + size()
+class MappedFile
+{
+public:
+    MappedFile(const char* filePath)
+    {
+#ifdef _WIN32
+        file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            return;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+            return;
+        bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (bytes)
+            length = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(filePath, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                bytes = (const char*)p;
+                length = (size_t)st.st_size;
+                madvise(p, length, MADV_SEQUENTIAL); // read once from front to back
+            }
+        }
+        close(fd); // the mapping keeps the file alive
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (bytes) munmap((void*)bytes, length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false when the file couldn't be opened or is empty
+    bool good() const { return bytes != NULL; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = NULL;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
@@ -7,6 +7,8 @@
 #include <vector>
 #include <map>
 #include "shader_s.h"
+#include "textures.h"
+#include "TextureResidency.h"
 
 
 // materials currently only include basic diffuse and specular properties
@@ -28,6 +30,12 @@ public:
     void lastChange(double _lc) { _lastChange = _lc; }
     double lastChange() { return _lastChange; }
 
+private:
+    void retainTextures() {
+        for (GLint t : textures)
+            Texture::retain(t);
+    }
+
 public:
     Material(Shader* _shader, std::string _name, GLint _texture, glm::vec4 _color) {
         assert(_shader != NULL);
@@ -36,6 +44,7 @@ public:
         color = _color;
         name = _name;
         materials[name] = this;
+        retainTextures();
     }
     Material(Shader* _shader, std::string _name, GLint _texture, GLint _envTexture) {
         assert(_shader != NULL);
@@ -46,6 +55,7 @@ public:
         shadow = false;
         name = _name;
         materials[name] = this;
+        retainTextures();
     }
     Material(Shader* _shader, std::string _name, GLint _texture, GLint depthMap, bool _shadow) {
         assert(_shader != NULL);
@@ -56,17 +66,30 @@ public:
         shadow = _shadow;
         name = _name;
         materials[name] = this;
+        retainTextures();
     }
     ~Material() {
         materials.erase(name);
+        // a cached texture goes with the last material using it (see Texture in textures.h)
+        for (GLint t : textures)
+            Texture::release(t);
+    }
+
+    // puts texture in the slot, keeping the texture cache's counts right
+    void setTexture(int slot, GLint texture) {
+        Texture::retain(texture);
+        Texture::release(textures[slot]);
+        textures[slot] = texture;
     }
 
-    unsigned int use(enum SceneGraph::rp enc) {
+    // binds the shader and the textures, the caller sets the rest of the uniforms on the shader it returns
+    Shader* use(enum SceneGraph::rp enc) {
 
         if (enc == SceneGraph::SHADOW) { // try to use a simplified shader if we're in the shadow pass
             if ((myShader != Shader::shaders["SkyBox"]) && (myShader != Shader::shaders["Particle"])) {
-                Shader::shaders["Depth"]->use();
-                return Shader::shaders["Depth"]->ID;
+                Shader* depth = Shader::shaders["Depth"];
+                depth->use();
+                return depth;
             }
         }
         assert(myShader != NULL);
@@ -75,20 +98,29 @@ public:
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textures[0]);
-        myShader->setInt("OurTexture", 0);
+        myShader->setInt(Uniform::OurTexture, 0);
 
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, textures[1]);
-        myShader->setInt("shadowMap", 1);
+        myShader->setInt(Uniform::shadowMap, 1);
         
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_CUBE_MAP, textures[2]);
-        myShader->setInt("EnvTexture", 2);
+        myShader->setInt(Uniform::EnvTexture, 2);
+
+        myShader->setFloat(Uniform::shine, shine);
 
-        glUniform1f(glGetUniformLocation(myShader->ID, "shine"), shine);
+        myShader->setVec4(Uniform::ourColor, color);
 
-        glUniform4fv(glGetUniformLocation(myShader->ID, "ourColor"), 1, glm::value_ptr(color));
+        return myShader;
+    }
 
-        return myShader->ID;
+    // call right before a draw with the shader use() returned, the textures it samples are marked as in use
+    // (the residency manager cuts down the ones that aren't), a slot the shader has no sampler for doesn't count
+    void drawn(const Shader* shader) {
+        static const unsigned int samplers[3] = { Uniform::OurTexture, Uniform::shadowMap, Uniform::EnvTexture };
+        for (int i = 0; i < 3; i++)
+            if (shader->location(samplers[i]) >= 0)
+                textureSampled(textures[i]);
     }
 };
@@ -0,0 +1,240 @@
+//
+// .g4gmesh model caches, see MeshCache.h for the layout
+// nothing in here touches GL, ObjModel does the upload
+//
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+
+#include "MeshCache.h"
+
+// the size and modification time of the OBJ, what a cache has to match to be used
+static bool sourceStamp(const char* objPath, long long& size, long long& time)
+{
+    std::error_code error;
+    auto bytes = std::filesystem::file_size(objPath, error);
+    if (error)
+        return false;
+    auto written = std::filesystem::last_write_time(objPath, error);
+    if (error)
+        return false;
+
+    size = (long long)bytes;
+    time = (long long)written.time_since_epoch().count();
+    return true;
+}
+
+bool MeshCache::load(const char* objPath)
+{
+    long long size, time;
+    if (!sourceStamp(objPath, size, time))
+        return false;
+
+    std::string cachePath = pathFor(objPath);
+    std::unique_ptr<MappedFile> mapped = std::make_unique<MappedFile>(cachePath.c_str());
+    if (!mapped->good())
+        return false;
+
+    const char* p = mapped->data();
+    const char* end = p + mapped->size();
+
+    MeshCacheHeader header;
+    if (mapped->size() < sizeof(header))
+        return false;
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.floatsPerVertex != 8 ||
+        (header.indexSize != 2 && header.indexSize != 4) || header.lodCount == 0) {
+        std::cout << cachePath << " is from another version, ignoring it\n";
+        return false;
+    }
+    if (header.sourceSize != size || header.sourceTime != time) {
+        std::cout << cachePath << " is older than " << objPath << ", ignoring it\n";
+        return false;
+    }
+
+    size_t vertexBytes = (size_t)header.vertexCount * header.floatsPerVertex * sizeof(float);
+    size_t indexBytes = ((size_t)header.indexCount * header.indexSize + 3) & ~(size_t)3;
+    if ((size_t)(end - p) < vertexBytes + indexBytes) {
+        std::cout << cachePath << " is cut short, ignoring it\n";
+        return false;
+    }
+
+    const float* cachedVertices = (const float*)p;
+    p += vertexBytes;
+    const void* cachedIndices = p;
+    p += indexBytes;
+
+    // the tables are small, they are copied out
+    auto readUnsigned = [&](unsigned& value) {
+        if (end - p < (ptrdiff_t)sizeof(value))
+            return false;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return true;
+    };
+    auto readString = [&](std::string& s) {
+        unsigned length;
+        if (!readUnsigned(length) || (size_t)(end - p) < length)
+            return false;
+        s.assign(p, length);
+        p += length;
+        return true;
+    };
+
+    // the counts size the tables before they are read, so each has to fit in what is left of the file first
+    // (a mesh is at least its start and name length, a library its name length, a level its three words and starts)
+    size_t left = (size_t)(end - p);
+    size_t nameBytes = (size_t)header.meshCount * 8 + (size_t)header.materialLibCount * 4;
+    size_t levelBytes = 12 + 4 * (size_t)header.meshCount;
+    if (left < nameBytes || header.lodCount > (left - nameBytes) / levelBytes) {
+        std::cout << cachePath << " is cut short, ignoring it\n";
+        return false;
+    }
+
+    std::vector<objMesh> cachedMeshes(header.meshCount);
+    for (objMesh& mesh : cachedMeshes) {
+        unsigned start;
+        if (!readUnsigned(start) || !readString(mesh.myName)) {
+            std::cout << cachePath << " is cut short, ignoring it\n";
+            return false;
+        }
+        mesh.startingVert = (int)start;
+    }
+
+    std::vector<std::string> cachedLibs(header.materialLibCount);
+    for (std::string& lib : cachedLibs)
+        if (!readString(lib)) {
+            std::cout << cachePath << " is cut short, ignoring it\n";
+            return false;
+        }
+
+    std::vector<objLOD> cachedLods(header.lodCount);
+    for (objLOD& lod : cachedLods) {
+        unsigned error = 0;
+        lod.starts.resize(header.meshCount);
+        bool good = readUnsigned(lod.firstIndex) && readUnsigned(lod.indexCount) && readUnsigned(error);
+        for (unsigned& start : lod.starts)
+            good = good && readUnsigned(start);
+        if (!good) {
+            std::cout << cachePath << " is cut short, ignoring it\n";
+            return false;
+        }
+        memcpy(&lod.error, &error, sizeof(error));
+        if ((size_t)lod.firstIndex + lod.indexCount > header.indexCount) {
+            std::cout << cachePath << " has levels of detail past its indices, ignoring it\n";
+            return false;
+        }
+        for (size_t i = 0; i < lod.starts.size(); i++)
+            if (lod.starts[i] > lod.indexCount || (i > 0 && lod.starts[i] < lod.starts[i - 1])) {
+                std::cout << cachePath << " has submeshes out of order, ignoring it\n";
+                return false;
+            }
+    }
+
+    // a damaged file could send GL and the simplifier past the vertices, it's one pass over memory already mapped
+    bool indicesGood = true;
+    if (header.indexSize == 2) {
+        const unsigned short* index = (const unsigned short*)cachedIndices;
+        for (unsigned i = 0; i < header.indexCount && indicesGood; i++)
+            indicesGood = index[i] < header.vertexCount;
+    }
+    else {
+        const unsigned* index = (const unsigned*)cachedIndices;
+        for (unsigned i = 0; i < header.indexCount && indicesGood; i++)
+            indicesGood = index[i] < header.vertexCount;
+    }
+    if (!indicesGood) {
+        std::cout << cachePath << " has indices past its vertices, ignoring it\n";
+        return false;
+    }
+
+    vertices = cachedVertices;
+    vertexCount = header.vertexCount;
+    indices = cachedIndices;
+    indexCount = header.indexCount;
+    indexSize = header.indexSize;
+    meshes.swap(cachedMeshes);
+    materialLibs.swap(cachedLibs);
+    lods.swap(cachedLods);
+    file = std::move(mapped);
+    return true;
+}
+
+bool MeshCache::write(const char* objPath, const float* vertices, unsigned vertexCount, const void* indices, unsigned indexCount,
+    unsigned indexSize, const std::vector<objMesh>& meshes, const std::vector<std::string>& materialLibs, const std::vector<objLOD>& lods)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    if (!sourceStamp(objPath, header.sourceSize, header.sourceTime))
+        return false;
+    header.vertexCount = vertexCount;
+    header.floatsPerVertex = 8;
+    header.indexCount = indexCount;
+    header.indexSize = indexSize;
+    header.meshCount = (unsigned)meshes.size();
+    header.materialLibCount = (unsigned)materialLibs.size();
+    header.lodCount = (unsigned)lods.size();
+
+    // written to the side and renamed into place, so a crash half way never leaves a cache that looks whole
+    std::string cachePath = pathFor(objPath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.good())
+            return false;
+
+        auto writeUnsigned = [&](unsigned value) { out.write((const char*)&value, sizeof(value)); };
+        auto writeString = [&](const std::string& s) {
+            writeUnsigned((unsigned)s.size());
+            out.write(s.data(), s.size());
+        };
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)vertices, (std::streamsize)vertexCount * 8 * sizeof(float));
+        size_t indexBytes = (size_t)indexCount * indexSize;
+        out.write((const char*)indices, indexBytes);
+        static const char padding[4] = { 0, 0, 0, 0 };
+        out.write(padding, (4 - indexBytes % 4) % 4);
+
+        for (const objMesh& mesh : meshes) {
+            writeUnsigned((unsigned)mesh.startingVert);
+            writeString(mesh.myName);
+        }
+        for (const std::string& lib : materialLibs)
+            writeString(lib);
+        for (const objLOD& lod : lods) {
+            unsigned error;
+            memcpy(&error, &lod.error, sizeof(error));
+            writeUnsigned(lod.firstIndex);
+            writeUnsigned(lod.indexCount);
+            writeUnsigned(error);
+            for (size_t i = 0; i < meshes.size(); i++)
+                writeUnsigned(i < lod.starts.size() ? lod.starts[i] : lod.indexCount);
+        }
+
+        if (!out.good()) {
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
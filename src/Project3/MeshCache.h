@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "ImportedModel.h"
+#include "MappedFile.h"
+
+// binary copy of an imported OBJ, kept next to it as <file>.g4gmesh so the next launch skips the parse
+//
+// the file holds exactly what ObjModel hands to GL, so a load is a map and two glBufferData calls
+//   header          MeshCacheHeader below
+//   vertices        vertexCount * 8 floats, position / normal / texture coordinate
+//   indices         indexCount * indexSize bytes, padded to 4
+//   submeshes       meshCount * (int startingVert, unsigned name length, name)
+//   material libs   materialLibCount * (unsigned path length, path)
+//   levels          lodCount * (unsigned firstIndex, unsigned indexCount, float error, meshCount * unsigned start)
+//                   the first is the full mesh, all of them are in indices
+// numbers are stored in the machine's own byte order, a cache from another kind of machine fails the magic check
+// the cache is stale as soon as the OBJ's size or modification time differ from the ones recorded in it
+
+#define MESH_CACHE_MAGIC 0x48534D47u  // "GMSH"
+#define MESH_CACHE_VERSION 4      // 2 : faces with more than 4 corners are no longer cut short, 3 : optimized triangle order, 4 : levels of detail
+#define MESH_CACHE_EXTENSION ".g4gmesh"
+
+struct MeshCacheHeader
+{
+    unsigned magic, version;
+    long long sourceSize, sourceTime;
+    unsigned vertexCount, floatsPerVertex;
+    unsigned indexCount, indexSize;
+    unsigned meshCount, materialLibCount;
+    unsigned lodCount;
+};
+
+class MeshCache
+{
+public:
+    // valid after a successful load(), they point into the mapped file
+    const float* vertices = NULL;
+    unsigned vertexCount = 0;
+    const void* indices = NULL;
+    unsigned indexCount = 0, indexSize = 4;
+    std::vector<objMesh> meshes;
+    std::vector<std::string> materialLibs;
+    std::vector<objLOD> lods;
+
+    // maps the cache for objPath, false when there is none, it is stale or it doesn't make sense
+    bool load(const char* objPath);
+
+    // writes the cache for objPath, false (and no cache) when it couldn't be written
+    static bool write(const char* objPath, const float* vertices, unsigned vertexCount, const void* indices, unsigned indexCount,
+        unsigned indexSize, const std::vector<objMesh>& meshes, const std::vector<std::string>& materialLibs, const std::vector<objLOD>& lods);
+
+    static std::string pathFor(const char* objPath) { return std::string(objPath) + MESH_CACHE_EXTENSION; }
+
+private:
+    std::unique_ptr<MappedFile> file;
+};
@@ -0,0 +1,295 @@
+//
+// vertex cache, overdraw and vertex fetch ordering for indexed meshes, see MeshOptimizer.h
+//
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+
+#include "MeshOptimizer.h"
+
+using namespace glm;
+
+float vertexCacheACMR(const unsigned int* indices, size_t indexCount, unsigned int vertexCount)
+{
+    if (indexCount < 3)
+        return 0.0f;
+
+    // a vertex stamped at time t has been pushed out once VERTEX_CACHE_SIZE more have come in after it
+    std::vector<unsigned int> stamp(vertexCount, 0);
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int v = indices[i];
+        if (time - stamp[v] > VERTEX_CACHE_SIZE) {
+            stamp[v] = time++;
+            misses++;
+        }
+    }
+    return (float)misses / (indexCount / 3);
+}
+
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, unsigned int vertexCount, std::vector<size_t>* clusters)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // the triangles around every vertex, and how many of them haven't been emitted yet
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        live[indices[i]]++;
+
+    std::vector<size_t> first(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        first[v + 1] = first[v] + live[v];
+
+    std::vector<unsigned int> around(triangleCount * 3);
+    {
+        std::vector<size_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            around[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<unsigned int> stamp(vertexCount, 0);
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnds, candidates, out;
+    std::vector<size_t> hard;     // where the fan had to jump somewhere the cache knows nothing about
+    deadEnds.reserve(triangleCount * 3);
+    out.reserve(triangleCount * 3);
+
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    unsigned int cursor = 0;
+
+    // when the fan runs dry, a vertex that was used recently and still has triangles, or else the next one in order
+    auto skipDeadEnd = [&]() -> int {
+        while (!deadEnds.empty()) {
+            unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0)
+                return (int)v;
+        }
+        for (; cursor < vertexCount; cursor++)
+            if (live[cursor] > 0)
+                return (int)cursor;
+        return -1;
+    };
+
+    int fan = skipDeadEnd();
+    hard.push_back(0);
+
+    while (fan >= 0) {
+        // emit every triangle left around the fanning vertex
+        candidates.clear();
+        for (size_t k = first[fan]; k < first[fan + 1]; k++) {
+            unsigned int t = around[k];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+
+            for (int c = 0; c < 3; c++) {
+                unsigned int v = indices[t * 3 + c];
+                out.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - stamp[v] > VERTEX_CACHE_SIZE)
+                    stamp[v] = time++;
+            }
+        }
+
+        // fan next around the oldest vertex that will still be in the cache after its own triangles went through
+        int next = -1, best = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - stamp[v] + 2 * live[v] <= VERTEX_CACHE_SIZE)
+                priority = (int)(time - stamp[v]);
+            if (priority > best) {
+                best = priority;
+                next = (int)v;
+            }
+        }
+        if (next < 0) {
+            next = skipDeadEnd();
+            if (next >= 0)
+                hard.push_back(out.size());
+        }
+        fan = next;
+    }
+
+    std::copy(out.begin(), out.end(), indices);
+
+    if (clusters == NULL)
+        return;
+
+    // split the runs further where their own ACMR (starting from a cold cache) has come close to the whole mesh's,
+    // a cluster drawn out of order costs about a cold start, and this keeps that within the threshold
+    float limit = vertexCacheACMR(indices, out.size(), vertexCount) * OVERDRAW_ACMR_THRESHOLD;
+    hard.push_back(out.size());
+    std::fill(stamp.begin(), stamp.end(), 0);
+    time = VERTEX_CACHE_SIZE + 1;
+
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t misses = 0, triangles = 0;
+        clusters->push_back(hard[h]);
+        time += VERTEX_CACHE_SIZE + 1;
+
+        for (size_t i = hard[h]; i < hard[h + 1]; i += 3) {
+            for (int c = 0; c < 3; c++) {
+                unsigned int v = indices[i + c];
+                if (time - stamp[v] > VERTEX_CACHE_SIZE) {
+                    stamp[v] = time++;
+                    misses++;
+                }
+            }
+            triangles++;
+
+            if (i + 3 < hard[h + 1] && (float)misses / triangles <= limit) {
+                clusters->push_back(i + 3);
+                misses = triangles = 0;
+                time += VERTEX_CACHE_SIZE + 1;
+            }
+        }
+    }
+}
+
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, unsigned int stride, const std::vector<size_t>& clusters)
+{
+    struct Cluster {
+        size_t begin, end;
+        vec3 centroid, normal;
+        float area;
+        float outside;
+    };
+
+    auto position = [&](unsigned int v) { return vec3(positions[(size_t)v * stride], positions[(size_t)v * stride + 1], positions[(size_t)v * stride + 2]); };
+
+    std::vector<Cluster> order(clusters.size());
+    vec3 center(0.0f);
+    float area = 0.0f;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = order[c];
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : indexCount;
+        cluster.centroid = cluster.normal = vec3(0.0f);
+        cluster.area = 0.0f;
+
+        // area weighted, so a few slivers don't drag the centroid around
+        for (size_t i = cluster.begin; i + 2 < cluster.end; i += 3) {
+            vec3 a = position(indices[i]), b = position(indices[i + 1]), d = position(indices[i + 2]);
+            vec3 n = cross(b - a, d - a);
+            float weight = length(n);
+            cluster.centroid += (a + b + d) * (weight / 3.0f);
+            cluster.normal += n;
+            cluster.area += weight;
+        }
+        center += cluster.centroid;
+        area += cluster.area;
+        if (cluster.area > 0.0f)
+            cluster.centroid /= cluster.area;
+    }
+    if (area > 0.0f)
+        center /= area;
+
+    // how far out the cluster sits along the way it faces, the ones furthest out go first
+    for (Cluster& cluster : order) {
+        float length = glm::length(cluster.normal);
+        cluster.outside = length > 0.0f ? dot(cluster.centroid - center, cluster.normal / length) : 0.0f;
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Cluster& a, const Cluster& b) { return a.outside > b.outside; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indexCount);
+    for (const Cluster& cluster : order)
+        sorted.insert(sorted.end(), indices + cluster.begin, indices + cluster.end);
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+void optimizeVertexFetch(float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount, unsigned int* indices, size_t indexCount)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertexCount, unused);
+    unsigned int next = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int& v = remap[indices[i]];
+        if (v == unused)
+            v = next++;
+        indices[i] = v;
+    }
+    for (unsigned int& v : remap)
+        if (v == unused)
+            v = next++;
+
+    std::vector<float> moved((size_t)vertexCount * floatsPerVertex);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        std::copy(vertices + (size_t)v * floatsPerVertex, vertices + (size_t)(v + 1) * floatsPerVertex, moved.begin() + (size_t)remap[v] * floatsPerVertex);
+    std::copy(moved.begin(), moved.end(), vertices);
+}
+
+void optimizeTriangleOrder(const float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, bool overdraw)
+{
+    std::vector<size_t> ranges;
+    ranges.push_back(0);
+    for (size_t start : starts)
+        if (start > ranges.back() && start < indexCount)
+            ranges.push_back(start);
+    ranges.push_back(indexCount);
+
+    // each submesh is optimized on its own, with its vertices numbered from 0 so the work
+    // follows the size of the submesh rather than the whole model
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> toLocal(vertexCount, unused), toGlobal, local;
+    std::vector<size_t> clusters;
+
+    for (size_t r = 0; r + 1 < ranges.size(); r++) {
+        unsigned int* range = indices + ranges[r];
+        size_t count = (ranges[r + 1] - ranges[r]) / 3 * 3;
+
+        local.resize(count);
+        toGlobal.clear();
+        for (size_t i = 0; i < count; i++) {
+            unsigned int& v = toLocal[range[i]];
+            if (v == unused) {
+                v = (unsigned int)toGlobal.size();
+                toGlobal.push_back(range[i]);
+            }
+            local[i] = v;
+        }
+
+        clusters.clear();
+        optimizeVertexCache(local.data(), count, (unsigned int)toGlobal.size(), overdraw ? &clusters : NULL);
+
+        for (size_t i = 0; i < count; i++)
+            range[i] = toGlobal[local[i]];
+        for (unsigned int v : toGlobal)
+            toLocal[v] = unused;
+
+        if (overdraw)
+            optimizeOverdraw(range, count, vertices, floatsPerVertex, clusters);
+    }
+}
+
+void optimizeMesh(const char* name, float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, bool overdraw, bool quiet)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    float before = vertexCacheACMR(indices, indexCount, vertexCount);
+
+    optimizeTriangleOrder(vertices, floatsPerVertex, vertexCount, indices, indexCount, starts, overdraw);
+    optimizeVertexFetch(vertices, floatsPerVertex, vertexCount, indices, indexCount);
+
+    if (quiet)
+        return;
+    std::cout << name << " : ACMR " << before << " -> " << vertexCacheACMR(indices, indexCount, vertexCount) << " ("
+        << VERTEX_CACHE_SIZE << " vertex cache" << (overdraw ? ", overdraw ordered" : "") << ") in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * 1000 << " ms\n";
+}
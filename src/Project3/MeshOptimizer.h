@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// triangle and vertex reordering so indexed meshes are cheaper to draw, the pictures don't change
+// nothing in here touches GL, the models run it on their buffers before uploading them
+//
+// the GPU keeps the last few transformed vertices around, a triangle whose corners are still there
+// skips the vertex shader for them, the ACMR (average cache miss ratio) is how many vertices get
+// transformed per triangle, 3 when nothing is ever shared and approaching 0.5 on a big regular grid
+
+// the post-transform cache size aimed for and simulated, real ones hold somewhere around 16 to 32
+#define VERTEX_CACHE_SIZE 16
+
+// a cluster from optimizeVertexCache() is split once its own ACMR is within this factor of the whole mesh's,
+// smaller clusters give optimizeOverdraw() more to work with at the price of a few more cache misses
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+// ACMR of the triangles through a FIFO cache of VERTEX_CACHE_SIZE vertices
+float vertexCacheACMR(const unsigned int* indices, size_t indexCount, unsigned int vertexCount);
+
+// reorders the triangles for the vertex cache with Tipsify (Sander, Nehab and Barczak 2007)
+// when clusters isn't NULL the index each run of triangles starts at is appended to it (see optimizeOverdraw())
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, unsigned int vertexCount, std::vector<size_t>* clusters = NULL);
+
+// reorders the clusters from optimizeVertexCache() so the ones on the outside of the mesh that face out are
+// drawn first and hide more of what comes after them, positions holds x, y, z at the start of every stride floats
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, unsigned int stride, const std::vector<size_t>& clusters);
+
+// renumbers the vertices in the order the triangles first use them (moving floatsPerVertex floats each),
+// so vertex fetches walk forward through the buffer, vertices no triangle uses end up at the back
+void optimizeVertexFetch(float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount, unsigned int* indices, size_t indexCount);
+
+// optimizeVertexCache() and optimizeOverdraw() on every submesh (see optimizeMesh()) without moving any vertices,
+// for index lists that share their vertices with another one, like the levels of detail in MeshSimplifier.h
+void optimizeTriangleOrder(const float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, bool overdraw = true);
+
+// all three for a mesh with x, y, z first in every vertex, printing the ACMR before and after unless quiet
+// (procedural primitives are built all the time, imported meshes once before they are cached)
+// starts holds the first index of every submesh (see objMesh), triangles are only reordered within their submesh
+void optimizeMesh(const char* name, float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, bool overdraw = true, bool quiet = false);
@@ -0,0 +1,253 @@
+//
+// quadric error edge collapses for levels of detail, see MeshSimplifier.h
+//
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#include "MeshSimplifier.h"
+
+using namespace glm;
+
+// the sum of the squared distances to a set of planes, each weighted by its triangle's area
+// xx xy xz xd yy yz yd zz zd dd of the plane (x, y, z, d)
+struct Quadric {
+    double a[10] = { 0 };
+    double weight = 0.0;
+
+    void addPlane(dvec3 n, double d, double w)
+    {
+        double p[4] = { n.x, n.y, n.z, d };
+        int k = 0;
+        for (int i = 0; i < 4; i++)
+            for (int j = i; j < 4; j++)
+                a[k++] += w * p[i] * p[j];
+        weight += w;
+    }
+
+    void add(const Quadric& q)
+    {
+        for (int k = 0; k < 10; k++)
+            a[k] += q.a[k];
+        weight += q.weight;
+    }
+
+    // the average squared distance from v to the planes
+    double error(dvec3 v) const
+    {
+        double e = a[0] * v.x * v.x + 2 * a[1] * v.x * v.y + 2 * a[2] * v.x * v.z + 2 * a[3] * v.x
+            + a[4] * v.y * v.y + 2 * a[5] * v.y * v.z + 2 * a[6] * v.y
+            + a[7] * v.z * v.z + 2 * a[8] * v.z
+            + a[9];
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;      /// positions
+    unsigned int toVertex;      /// the vertex at to that takes over from's triangles
+    double cost;
+};
+
+float simplifyMesh(const float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    const unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, size_t targetIndexCount,
+    std::vector<unsigned int>& out, std::vector<size_t>& outStarts)
+{
+    auto vertexPosition = [&](unsigned int v) { return dvec3(vertices[(size_t)v * floatsPerVertex], vertices[(size_t)v * floatsPerVertex + 1], vertices[(size_t)v * floatsPerVertex + 2]); };
+
+    // vertices sharing a position (seams) are one position here, the collapses move positions
+    std::vector<unsigned int> byPosition(vertexCount);
+    std::iota(byPosition.begin(), byPosition.end(), 0u);
+    std::sort(byPosition.begin(), byPosition.end(), [&](unsigned int a, unsigned int b) {
+        const float* p = vertices + (size_t)a * floatsPerVertex;
+        const float* q = vertices + (size_t)b * floatsPerVertex;
+        return std::lexicographical_compare(p, p + 3, q, q + 3);
+    });
+
+    std::vector<unsigned int> where(vertexCount);   /// vertex to position
+    std::vector<dvec3> positions;
+    std::vector<unsigned char> locked;              /// positions that never move
+    for (size_t i = 0; i < byPosition.size(); i++) {
+        unsigned int v = byPosition[i];
+        if (i > 0 && std::equal(vertices + (size_t)v * floatsPerVertex, vertices + (size_t)v * floatsPerVertex + 3,
+            vertices + (size_t)byPosition[i - 1] * floatsPerVertex)) {
+            locked.back() = 1;
+        }
+        else {
+            positions.push_back(vertexPosition(v));
+            locked.push_back(0);
+        }
+        where[v] = (unsigned int)positions.size() - 1;
+    }
+    unsigned int positionCount = (unsigned int)positions.size();
+
+    // the triangles as they simplify, each remembering where it was in indices
+    std::vector<unsigned int> triangles(indices, indices + indexCount / 3 * 3);
+    std::vector<unsigned int> original(triangles.size() / 3);
+    std::iota(original.begin(), original.end(), 0u);
+
+    // a position on two submeshes is between materials
+    {
+        std::vector<int> owner(positionCount, -1);
+        size_t submesh = 0;
+        for (size_t i = 0; i < triangles.size(); i++) {
+            while (submesh < starts.size() && starts[submesh] <= i / 3 * 3)
+                submesh++;
+            int& o = owner[where[triangles[i]]];
+            if (o < 0)
+                o = (int)submesh;
+            else if (o != (int)submesh)
+                locked[where[triangles[i]]] = 1;
+        }
+    }
+
+    // an edge that isn't shared by exactly two triangles is on a border (or worse)
+    {
+        std::vector<unsigned long long> edges;
+        edges.reserve(triangles.size());
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; k++) {
+                unsigned long long a = where[triangles[t + k]], b = where[triangles[t + (k + 1) % 3]];
+                edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+            }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+            if (j - i != 2) {
+                locked[(size_t)(edges[i] >> 32)] = 1;
+                locked[(size_t)(edges[i] & 0xFFFFFFFFu)] = 1;
+            }
+            i = j;
+        }
+    }
+
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        dvec3 a = positions[where[triangles[t]]], b = positions[where[triangles[t + 1]]], c = positions[where[triangles[t + 2]]];
+        dvec3 n = cross(b - a, c - a);
+        double area = length(n);
+        if (area == 0.0)
+            continue;
+        n /= area;
+        for (int k = 0; k < 3; k++)
+            quadrics[where[triangles[t + k]]].addPlane(n, -dot(n, a), area * 0.5);
+    }
+
+    std::vector<size_t> first(positionCount + 1);
+    std::vector<unsigned int> around, moveTo(positionCount, ~0u), vertexTo(positionCount);
+    std::vector<unsigned char> touched(positionCount);
+    std::vector<Collapse> collapses;
+    double error = 0.0;
+
+    size_t target = targetIndexCount / 3 * 3;
+    while (triangles.size() > target) {
+        // the triangles around every position
+        std::fill(first.begin(), first.end(), 0);
+        for (unsigned int v : triangles)
+            first[where[v] + 1]++;
+        for (unsigned int p = 0; p < positionCount; p++)
+            first[p + 1] += first[p];
+        around.resize(triangles.size());
+        {
+            std::vector<size_t> fill(first.begin(), first.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++)
+                around[fill[where[triangles[i]]]++] = (unsigned int)(i / 3);
+        }
+
+        // every half edge once, the other half comes from the triangle on the other side
+        collapses.clear();
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; k++) {
+                unsigned int from = where[triangles[t + k]], to = where[triangles[t + (k + 1) % 3]];
+                if (locked[from])
+                    continue;
+                Quadric q = quadrics[from];
+                q.add(quadrics[to]);
+                collapses.push_back({ from, to, triangles[t + (k + 1) % 3], q.error(positions[to]) });
+            }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // a collapse takes about two triangles, and only the cheap ones go, the rest wait for the next pass
+        // (when they might not be the cheapest any more)
+        size_t wanted = (triangles.size() - target) / 6 + 1;
+        double cutoff = collapses[std::min(wanted, collapses.size()) - 1].cost * 1.5;
+
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapsed = 0;
+
+        for (const Collapse& c : collapses) {
+            if (collapsed == wanted || c.cost > cutoff)
+                break;
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            // none of the triangles that stay may turn over (or nearly so)
+            bool flips = false;
+            for (size_t k = first[c.from]; k < first[c.from + 1] && !flips; k++) {
+                const unsigned int* t = &triangles[(size_t)around[k] * 3];
+                dvec3 before[3], after[3];
+                bool dies = false;
+                for (int i = 0; i < 3; i++) {
+                    unsigned int p = where[t[i]];
+                    dies |= p == c.to;
+                    before[i] = positions[p];
+                    after[i] = p == c.from ? positions[c.to] : positions[p];
+                }
+                if (dies)
+                    continue;
+                dvec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+                dvec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+                flips = dot(n0, n1) <= 0.25 * length(n0) * length(n1);
+            }
+            if (flips)
+                continue;
+
+            // everything around from changes, nothing there moves again this pass
+            for (size_t k = first[c.from]; k < first[c.from + 1]; k++)
+                for (int i = 0; i < 3; i++)
+                    touched[where[triangles[(size_t)around[k] * 3 + i]]] = 1;
+
+            moveTo[c.from] = c.to;
+            vertexTo[c.from] = c.toVertex;
+            quadrics[c.to].add(quadrics[c.from]);
+            error = std::max(error, c.cost);
+            collapsed++;
+        }
+        if (collapsed == 0)
+            break;
+
+        // move the corners, the triangles that were on a collapsed edge are gone
+        size_t kept = 0;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            unsigned int corner[3];
+            for (int i = 0; i < 3; i++) {
+                unsigned int v = triangles[t + i];
+                corner[i] = moveTo[where[v]] == ~0u ? v : vertexTo[where[v]];
+            }
+            if (where[corner[0]] == where[corner[1]] || where[corner[1]] == where[corner[2]] || where[corner[2]] == where[corner[0]])
+                continue;
+            std::copy(corner, corner + 3, &triangles[kept]);
+            original[kept / 3] = original[t / 3];
+            kept += 3;
+        }
+        triangles.resize(kept);
+        original.resize(kept / 3);
+
+        std::fill(moveTo.begin(), moveTo.end(), ~0u);
+    }
+
+    out.swap(triangles);
+    outStarts.clear();
+    for (size_t start : starts)
+        outStarts.push_back(3 * (size_t)(std::lower_bound(original.begin(), original.end(), (unsigned int)(start / 3)) - original.begin()));
+
+    return (float)sqrt(error);
+}
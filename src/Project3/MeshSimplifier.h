@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// mesh simplification for levels of detail, nothing in here touches GL
+//
+// edges are collapsed cheapest first, the cost being how far the moved vertex ends up from the planes of the
+// triangles it (and everything collapsed into it before) started out on, the quadric error metric of
+// Garland and Heckbert 1997
+// a vertex always collapses onto one of its neighbours, so every level indexes the same vertices as the full
+// mesh and a model keeps one vertex buffer with the levels' indices one after the other in its index buffer
+//
+// vertices on an open border, on a texture or normal seam (one position, several vertices) or between two
+// submeshes never move, so the levels don't crack or smear textures, a mesh made mostly of those doesn't
+// simplify much
+
+// how far the next level's triangle count is cut, and how many levels a model gets at most
+#define LOD_REDUCTION 0.5f
+#define LOD_MAX_LEVELS 5
+
+// simplifies indexCount indices (x, y, z first in every floatsPerVertex floats of vertices) down to about
+// targetIndexCount, writing the result to out and the index each submesh starts at in it to outStarts
+// (starts is the same for the input, see objMesh, the triangles stay in their submesh and in their order)
+// returns the geometric error of the result, in the model's units
+float simplifyMesh(const float* vertices, unsigned int floatsPerVertex, unsigned int vertexCount,
+    const unsigned int* indices, size_t indexCount, const std::vector<size_t>& starts, size_t targetIndexCount,
+    std::vector<unsigned int>& out, std::vector<size_t>& outStarts);
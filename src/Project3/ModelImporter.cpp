@@ -0,0 +1,742 @@
+//
+// OBJ parsing for ModelImporter
+// nothing in here touches GL, so the headless ray tracer can load models too
+// (readMTL only reads, parseMTL creates the Materials and textures and lives with ObjModel in ImportedModel.cpp)
+//
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+
+#include "ImportedModel.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace glm;
+
+bool importerVerbose = false;
+
+ModelImporter::ModelImporter() {}
+
+string ModelImporter::getPathName(const string& s) {
+
+   char sep = '/';
+
+   size_t i = s.rfind(sep, s.length());
+   if (i != string::npos) {
+      return(s.substr(0, i) + "/");
+   }
+
+   sep = '\\';
+
+   i = s.rfind(sep, s.length());
+   if (i != string::npos) {
+       return(s.substr(0, i) + "/");
+   }
+
+   return("");
+}
+
+// ---------------------------------------------------------------
+// the OBJ tokenizer, everything works on [p, end) of the mapped file and never reads past end
+
+static inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+static inline void skipBlanks(const char*& p, const char* end)
+{
+    while (p < end && isBlank(*p)) p++;
+}
+
+// one past the last character of the token starting at p
+static inline const char* tokenEnd(const char* p, const char* end)
+{
+    while (p < end && !isBlank(*p) && *p != '\n') p++;
+    return p;
+}
+
+static const float powersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+// reads a float like istream >> float does, 0 when there is no number
+// up to 2^24 for the digits and 10^10 for the exponent both are exact floats, so one multiply or divide
+// rounds just like strtof, longer numbers are handed to strtof itself
+static float parseFloat(const char*& p, const char* end)
+{
+    skipBlanks(p, end);
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    const char* digits = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        mantissa = mantissa * 10 + (*p - '0');
+    size_t digitCount = p - digits;
+    int exponent = 0;
+    if (p < end && *p == '.') {
+        const char* fraction = ++p;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            mantissa = mantissa * 10 + (*p - '0');
+        exponent = -(int)(p - fraction);
+        digitCount += p - fraction;
+    }
+
+    if (digitCount == 0) {
+        p = start;
+        return 0;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9') {
+            int x = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++)
+                if (x < 10000) x = x * 10 + (*e - '0');
+            exponent += negativeExponent ? -x : x;
+            p = e;
+        }
+    }
+
+    // more than 19 digits may have overflowed the mantissa, strtof sorts those out
+    if (digitCount <= 19 && mantissa <= (1 << 24) && exponent >= -10 && exponent <= 10) {
+        float f = (float)mantissa;
+        f = exponent < 0 ? f / powersOf10[-exponent] : f * powersOf10[exponent];
+        return negative ? -f : f;
+    }
+
+    char buffer[64];
+    size_t length = p - start;
+    if (length < sizeof(buffer)) {
+        memcpy(buffer, start, length);
+        buffer[length] = 0;
+        return strtof(buffer, NULL);
+    }
+    return strtof(string(start, length).c_str(), NULL);
+}
+
+// reads a decimal int, false (and value untouched) when there isn't one
+static inline bool parseInt(const char*& p, const char* end, int& value)
+{
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+'))
+        negative = *q++ == '-';
+    if (q >= end || *q < '0' || *q > '9')
+        return false;
+
+    int x = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++)
+        x = x * 10 + (*q - '0');
+    value = negative ? -x : x;
+    p = q;
+    return true;
+}
+
+// one face corner, v, v/vt, v//vn or v/vt/vn, the indices that are left out stay 0
+// end is the end of the corner's token, anything left over (1e0, 1/2/3/4, 3abc) makes it unreadable
+static bool parseCorner(const char* p, const char* end, vertIndices& corner)
+{
+    corner.vi = corner.ti = corner.ni = 0;
+    if (!parseInt(p, end, corner.vi))
+        return false;
+    if (p < end && *p == '/') {
+        p++;
+        parseInt(p, end, corner.ti);
+        if (p < end && *p == '/') {
+            p++;
+            parseInt(p, end, corner.ni);
+        }
+    }
+    return p == end;
+}
+
+// the rest of the line as one word, for names
+static string parseWord(const char*& p, const char* end)
+{
+    skipBlanks(p, end);
+    const char* word = p;
+    p = tokenEnd(p, end);
+    return string(word, p);
+}
+
+// a run of whole lines of the OBJ, parsed on its own
+// vertices only know their place within the chunk and faces are kept as indices until every
+// chunk is done, then parseOBJ() lays the chunks end to end and triangulates the faces
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<vec3> vertVals, normVals;
+    std::vector<vec2> stVals;
+    std::vector<vertIndices> corners;           /// every face's corners as written, not triangulated yet
+    std::vector<unsigned> faceCorners;          /// how many corners each face has in corners, 3 or more
+    size_t triangleCorners = 0;                 /// how many the faces will have once they are triangles, 3 * (corners - 2) each
+    unsigned shortFaces = 0, unreadableFaces = 0;   /// faces skipped for having fewer than 3 corners, or corners that didn't parse
+    std::vector<unsigned> relative;             /// corner * 3 + (0 vi, 1 ti, 2 ni) for negative indices, those count from the chunk start
+    std::vector<std::pair<string, size_t>> materials;   /// usemtl name and the triangle corner it starts at
+    std::vector<string> materialLibs;
+
+    // where this chunk's attributes and corners go in the whole model
+    size_t firstVert = 0, firstSt = 0, firstNorm = 0, firstCorner = 0;
+};
+
+// counts the lines of each kind and the corners the faces will have, so the chunk's arrays are allocated
+// once at their final size instead of growing (and copying) their way there
+static void reserveOBJChunk(ObjChunk& chunk)
+{
+    size_t verts = 0, sts = 0, norms = 0, faces = 0, corners = 0;
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+
+    while (p < end) {
+        skipBlanks(p, end);
+        if (end - p > 1 && p[0] == 'v') {
+            if (isBlank(p[1])) verts++;
+            else if (p[1] == 't') sts++;
+            else if (p[1] == 'n') norms++;
+        }
+        else if (end - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+            int count = 0;
+            for (p++; p < end && *p != '\n'; count++) {
+                skipBlanks(p, end);
+                if (p >= end || *p == '\n')
+                    break;
+                p = tokenEnd(p, end);
+            }
+            faces++;
+            corners += count;
+        }
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        p = eol ? eol + 1 : end;
+    }
+
+    chunk.vertVals.reserve(verts);
+    chunk.stVals.reserve(sts);
+    chunk.normVals.reserve(norms);
+    chunk.corners.reserve(corners);
+    chunk.faceCorners.reserve(faces);
+}
+
+static void parseOBJChunk(ObjChunk& chunk)
+{
+    reserveOBJChunk(chunk);
+
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+
+    while (p < end) {
+        skipBlanks(p, end);
+        const char* word = p;
+        p = tokenEnd(p, end);
+        size_t length = p - word;
+
+        if (length == 1 && word[0] == 'v') { // vertex coordinates
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            chunk.vertVals.push_back(vec3(x, y, z));
+        }
+        else if (length == 2 && word[0] == 'v' && word[1] == 't') { // texture coordinates
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            chunk.stVals.push_back(vec2(x, y));
+        }
+        else if (length == 2 && word[0] == 'v' && word[1] == 'n') { // vertex normals
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            chunk.normVals.push_back(vec3(x, y, z));
+        }
+        else if (length == 1 && word[0] == 'f') { // faces
+            // any number of corners, they go in as written and parseOBJ() triangulates the face
+            // once every position is known (positive indices may point into earlier chunks)
+            size_t first = chunk.corners.size();
+            unsigned count = 0;
+            bool readable = true;
+
+            for (;; count++) {
+                skipBlanks(p, end);
+                if (p >= end || *p == '\n')
+                    break;
+
+                const char* next = tokenEnd(p, end);
+                vertIndices temp;
+
+                // parse each face's indices, a corner without a position index spoils the whole face
+                if (!parseCorner(p, next, temp) || temp.vi == 0)
+                    readable = false;
+                p = next;
+
+                // account for relative indexing, adjust by number of preceding attributes
+                // (in this chunk, the ones before it are added when the chunks are joined)
+                unsigned c = (unsigned)chunk.corners.size();
+                if (temp.vi < 0) temp.vi += chunk.vertVals.size() + 1, chunk.relative.push_back(c * 3);
+                if (temp.ti < 0) temp.ti += chunk.stVals.size() + 1, chunk.relative.push_back(c * 3 + 1);
+                if (temp.ni < 0) temp.ni += chunk.normVals.size() + 1, chunk.relative.push_back(c * 3 + 2);
+
+                chunk.corners.push_back(temp);
+            }
+
+            if (count < 3 || !readable) { // not a face at all
+                if (readable)
+                    chunk.shortFaces++;
+                else
+                    chunk.unreadableFaces++;
+                chunk.corners.resize(first);
+                while (!chunk.relative.empty() && chunk.relative.back() / 3 >= first)
+                    chunk.relative.pop_back();
+            }
+            else {
+                chunk.faceCorners.push_back(count);
+                chunk.triangleCorners += 3 * (size_t)(count - 2);
+            }
+        }
+        else if (length == 6 && memcmp(word, "mtllib", 6) == 0) { // uses a material library file
+            chunk.materialLibs.push_back(parseWord(p, end));
+        }
+        else if (length == 6 && memcmp(word, "usemtl", 6) == 0) { // use this material on the next faces, unitl next material
+            chunk.materials.push_back(std::make_pair(parseWord(p, end), chunk.triangleCorners));
+        }
+
+        // skip whatever is left of the line
+        while (p < end && *p != '\n') p++;
+        p++;
+    }
+}
+
+// reused from one polygon to the next by triangulatePolygon()
+struct PolygonScratch
+{
+    std::vector<vec2> points;
+    std::vector<unsigned> remaining;
+};
+
+// splits a polygon with count > 3 corners into count - 2 triangles written to out, keeping its winding
+// convex polygons (most of them) are fanned out from the first corner, the others have their ears
+// clipped one at a time, both in 2D in the plane the polygon mostly faces
+static void triangulatePolygon(const vertIndices* polygon, unsigned count, const std::vector<vec3>& positions,
+    vertIndices* out, PolygonScratch& scratch)
+{
+    auto position = [&](unsigned c) {
+        int vi = polygon[c].vi;
+        return vi > 0 && (size_t)vi <= positions.size() ? positions[vi - 1] : vec3(0.0f);
+    };
+    auto emit = [&](unsigned a, unsigned b, unsigned c) {
+        *out++ = polygon[a];
+        *out++ = polygon[b];
+        *out++ = polygon[c];
+    };
+    auto cross2 = [](vec2 a, vec2 b) { return a.x * b.y - a.y * b.x; };
+
+    // Newell's normal, it holds up for concave polygons too
+    vec3 normal(0.0f);
+    for (unsigned c = 0; c < count; c++) {
+        vec3 a = position(c), b = position((c + 1) % count);
+        normal += vec3((a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y));
+    }
+
+    // drop the axis the normal is closest to, the other two (in cyclic order) keep the polygon counter
+    // clockwise when that component is positive, so flip one of them when it isn't
+    int axis = 0;
+    if (fabsf(normal.y) > fabsf(normal[axis])) axis = 1;
+    if (fabsf(normal.z) > fabsf(normal[axis])) axis = 2;
+    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    float flip = normal[axis] < 0.0f ? -1.0f : 1.0f;
+
+    std::vector<vec2>& points = scratch.points;
+    points.resize(count);
+    for (unsigned c = 0; c < count; c++) {
+        vec3 p = position(c);
+        points[c] = vec2(p[u], p[v] * flip);
+    }
+
+    bool convex = normal[axis] != 0.0f;
+    for (unsigned c = 0; c < count && convex; c++) {
+        vec2 a = points[(c + count - 1) % count], b = points[c], d = points[(c + 1) % count];
+        convex = cross2(b - a, d - b) >= 0.0f;
+    }
+    if (convex || normal[axis] == 0.0f) {
+        // (a polygon with no area at all has nothing better to offer than a fan either)
+        for (unsigned c = 1; c + 1 < count; c++)
+            emit(0, c, c + 1);
+        return;
+    }
+
+    std::vector<unsigned>& remaining = scratch.remaining;
+    remaining.resize(count);
+    for (unsigned c = 0; c < count; c++)
+        remaining[c] = c;
+
+    while (remaining.size() > 3) {
+        size_t n = remaining.size();
+        size_t ear = n;
+
+        for (size_t i = 0; i < n && ear == n; i++) {
+            unsigned a = remaining[(i + n - 1) % n], b = remaining[i], c = remaining[(i + 1) % n];
+            vec2 pa = points[a], pb = points[b], pc = points[c];
+            if (cross2(pb - pa, pc - pb) <= 0.0f)
+                continue; // reflex (or flat), cutting it off would leave the polygon
+
+            // an ear has no reflex (or flat) corner inside it, and one on its edge counts as inside, a reflex
+            // corner right on the diagonal (grid aligned L shapes have them) would otherwise let the ear cut
+            // across the notch, only those corners can poke into an ear of a simple polygon
+            bool empty = true;
+            for (size_t j = 0; j < n && empty; j++) {
+                vec2 q = points[remaining[j]];
+                if (remaining[j] == a || remaining[j] == b || remaining[j] == c)
+                    continue;
+                vec2 qa = points[remaining[(j + n - 1) % n]], qc = points[remaining[(j + 1) % n]];
+                if (cross2(q - qa, qc - q) > 0.0f)
+                    continue; // convex
+                empty = !(cross2(pb - pa, q - pa) >= 0.0f && cross2(pc - pb, q - pb) >= 0.0f && cross2(pa - pc, q - pc) >= 0.0f);
+            }
+            if (empty)
+                ear = i;
+        }
+        // a self intersecting polygon can run out of ears, cut off any corner so it still ends
+        if (ear == n)
+            ear = 0;
+
+        emit(remaining[(ear + n - 1) % n], remaining[ear], remaining[(ear + 1) % n]);
+        remaining.erase(remaining.begin() + ear);
+    }
+    emit(remaining[0], remaining[1], remaining[2]);
+}
+
+// files smaller than this per thread aren't worth splitting
+#define OBJ_MIN_CHUNK (1 << 20)
+
+void ModelImporter::parseOBJ(const char* filePath, unsigned threads) {
+    auto startTime = chrono::steady_clock::now();
+
+    // the file is mapped and scanned in place, no line copies, streams or sscanf
+    std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>(filePath);
+    if (!file->good()) {
+        std::cout << "can't open " << filePath << "\n";
+        return;
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    if (threads != 0)
+        ownPool = std::make_unique<ThreadPool>(threads);
+    ThreadPool& pool = ownPool ? *ownPool : ThreadPool::shared();
+
+    // cut the file into a few chunks per thread at line ends, so a slow chunk doesn't hold up the rest
+    size_t fileSize = file->size();
+    size_t chunkCount = std::min((size_t)pool.size() * 4, fileSize / OBJ_MIN_CHUNK);
+    if (pool.size() == 1 || chunkCount < 2)
+        chunkCount = 1;
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* end = file->data() + fileSize;
+    const char* p = file->data();
+    for (size_t i = 0; i < chunkCount; i++) {
+        chunks[i].begin = p;
+        if (i + 1 == chunkCount)
+            p = end;
+        else {
+            p = std::max(p, file->data() + fileSize * (i + 1) / chunkCount);
+            while (p < end && *p != '\n') p++;
+            p = std::min(p + 1, end);
+        }
+        chunks[i].end = p;
+    }
+
+    pool.parallelFor((unsigned)chunkCount, [&](unsigned i) { parseOBJChunk(chunks[i]); });
+
+    // the chunks copied out everything they need, the text can go
+    file.reset();
+
+    // lay the chunks end to end, in file order so the result doesn't depend on the split
+    size_t vertCount = vertVals.size(), stCount = stVals.size(), normCount = normVals.size(), cornerCount = vertIndexList.size();
+    unsigned shortFaces = 0, unreadableFaces = 0;
+    for (ObjChunk& chunk : chunks) {
+        shortFaces += chunk.shortFaces;
+        unreadableFaces += chunk.unreadableFaces;
+        chunk.firstVert = vertCount, chunk.firstSt = stCount, chunk.firstNorm = normCount, chunk.firstCorner = cornerCount;
+        vertCount += chunk.vertVals.size();
+        stCount += chunk.stVals.size();
+        normCount += chunk.normVals.size();
+        cornerCount += chunk.triangleCorners;
+
+        for (const string& fname : chunk.materialLibs)
+            // remembered rather than loaded here, materials need GL and the parse doesn't
+            materialLibs.push_back(getPathName(filePath) + fname);
+
+        for (auto& material : chunk.materials) {
+            objMesh temp;
+            temp.myName = material.first;
+
+            if (meshes.empty() || (temp.myName != meshes.back().myName)) // only create mesh when there is a material change
+            {
+                temp.startingVert = (int)(chunk.firstCorner + material.second);
+                meshes.push_back(temp);
+            }
+        }
+    }
+
+    // a single chunk into an empty importer just hands its arrays over
+    // (its corners too when they are all triangles already, polygons grow when they are split)
+    bool handOver = chunkCount == 1 && vertVals.empty() && stVals.empty() && normVals.empty() && vertIndexList.empty();
+    bool cornersInPlace = handOver && chunks[0].corners.size() == chunks[0].triangleCorners;
+    if (handOver) {
+        vertVals.swap(chunks[0].vertVals);
+        stVals.swap(chunks[0].stVals);
+        normVals.swap(chunks[0].normVals);
+    }
+    else {
+        vertVals.resize(vertCount);
+        stVals.resize(stCount);
+        normVals.resize(normCount);
+    }
+    if (!cornersInPlace)
+        vertIndexList.resize(cornerCount);
+
+    pool.parallelFor((unsigned)chunkCount, [&](unsigned i) {
+        ObjChunk& chunk = chunks[i];
+        std::copy(chunk.vertVals.begin(), chunk.vertVals.end(), vertVals.begin() + chunk.firstVert);
+        std::copy(chunk.stVals.begin(), chunk.stVals.end(), stVals.begin() + chunk.firstSt);
+        std::copy(chunk.normVals.begin(), chunk.normVals.end(), normVals.begin() + chunk.firstNorm);
+        // each chunk lets go as soon as it has been copied, so the model is never held twice
+        std::vector<vec3>().swap(chunk.vertVals);
+        std::vector<vec2>().swap(chunk.stVals);
+        std::vector<vec3>().swap(chunk.normVals);
+    });
+
+    // every position is in place now, which polygons need to be split into triangles
+    std::atomic<unsigned> badFaces(0);
+    pool.parallelFor((unsigned)chunkCount, [&](unsigned i) {
+        ObjChunk& chunk = chunks[i];
+
+        // negative indices counted from the start of the chunk, now the attributes before it are known
+        for (unsigned r : chunk.relative) {
+            vertIndices& corner = chunk.corners[r / 3];
+            if (r % 3 == 0) corner.vi += (int)chunk.firstVert;
+            else if (r % 3 == 1) corner.ti += (int)chunk.firstSt;
+            else corner.ni += (int)chunk.firstNorm;
+        }
+
+        vertIndices* viList = chunk.corners.data();
+        vertIndices* corners = cornersInPlace ? chunk.corners.data() : vertIndexList.data() + chunk.firstCorner;
+        PolygonScratch scratch;     // shared by the chunk's polygons, so a face never allocates
+        size_t out = 0;
+
+        for (unsigned count : chunk.faceCorners) {
+            int face = (int)(chunk.firstCorner + out);
+            size_t triangleCorners = 3 * (size_t)(count - 2);
+
+            // only now is it known what the indices can point at, a face with one that points past the ends
+            // has its place in the arrays already, so it stays as a face with no area at the origin
+            bool inRange = true;
+            for (unsigned c = 0; c < count; c++)
+                inRange = inRange && viList[c].vi > 0 && (size_t)viList[c].vi <= vertVals.size() &&
+                    viList[c].ti >= 0 && (size_t)viList[c].ti <= stVals.size() && viList[c].ni >= 0 && (size_t)viList[c].ni <= normVals.size();
+            if (!inRange) {
+                badFaces++;
+                for (unsigned c = 0; c < count; c++)
+                    viList[c] = { 0, 0, 0 };
+            }
+
+            if (count == 3)
+                std::copy(viList, viList + 3, corners + out);
+            else
+                triangulatePolygon(viList, count, vertVals, corners + out, scratch);
+
+            for (size_t c = out; c < out + triangleCorners; c++)
+                // a corner without a normal gets its face's normal, so it must not be shared beyond the face
+                // (the face is named by its first corner, see corner())
+                if (corners[c].ni <= 0)
+                    corners[c].ni = -1 - face;
+
+            viList += count;
+            out += triangleCorners;
+        }
+
+        if (cornersInPlace)
+            vertIndexList.swap(chunk.corners);
+        else
+            std::vector<vertIndices>().swap(chunk.corners);
+    });
+
+    // one line for each kind of damage, however many faces have it
+    if (shortFaces)
+        std::cout << filePath << " : skipped " << shortFaces << " faces with fewer than 3 corners\n";
+    if (unreadableFaces)
+        std::cout << filePath << " : skipped " << unreadableFaces << " faces in a format that isn't implemented\n";
+    if (badFaces)
+        std::cout << filePath << " : " << badFaces << " faces refer to vertices, texture coordinates or normals that aren't there, they are left empty\n";
+
+    if (!importerVerbose)
+        return;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    std::cout << "parsed " << filePath << " : " << fileSize / (1024.0 * 1024.0) << " MB in " << seconds * 1000 << " ms ("
+        << fileSize / (1024.0 * 1024.0) / seconds << " MB/s) on " << chunkCount << " chunks, " << getNumVertices() / 3 << " triangles\n";
+}
+
+void ModelImporter::corner(size_t i, vec3& position, vec2& texCoord, vec3& normal) const {
+    const vertIndices& v = vertIndexList[i];
+
+    // references start at 1, not 0, so adjust
+    position = v.vi > 0 ? vertVals[v.vi - 1] : vec3(0.0f);
+    texCoord = v.ti > 0 ? stVals[v.ti - 1] : vec2(0.0f);
+
+    if (v.ni > 0)
+        normal = normVals[v.ni - 1];
+    else {
+        const vertIndices* viList = &vertIndexList[-1 - v.ni];
+
+        if (viList[0].ni <= 0) {
+            // if no normal, calculate a face formal from face edges
+            vec3 ab, bc;
+
+            // (an emptied face has no positions, see parseOBJ())
+            if (viList[0].vi > 0) {
+                ab = vertVals[viList[2].vi - 1] - vertVals[viList[1].vi - 1];
+                bc = vertVals[viList[0].vi - 1] - vertVals[viList[1].vi - 1];
+                normal = cross(ab, bc);
+            }
+            else
+                normal = vec3(0);
+        }
+        else // the face has normals, just not on this corner
+            normal = vec3(0);
+    }
+}
+
+void ModelImporter::expandCorners() {
+    if (triangleVerts.size() == vertIndexList.size())
+        return;
+
+    triangleVerts.resize(vertIndexList.size());
+    textureCoords.resize(vertIndexList.size());
+    normals.resize(vertIndexList.size());
+
+    for (size_t i = 0; i < vertIndexList.size(); i++)
+        corner(i, triangleVerts[i], textureCoords[i], normals[i]);
+}
+
+void ModelImporter::releaseCorners() {
+    std::vector<vec3>().swap(vertVals);
+    std::vector<vec2>().swap(stVals);
+    std::vector<vec3>().swap(normVals);
+    std::vector<vertIndices>().swap(vertIndexList);
+    std::vector<vec3>().swap(triangleVerts);
+    std::vector<vec2>().swap(textureCoords);
+    std::vector<vec3>().swap(normals);
+}
+
+struct VertIndicesHash
+{
+    size_t operator()(const vertIndices& v) const
+    {
+        unsigned long long h = (unsigned)v.vi * 0x9E3779B97F4A7C15ull;
+        h = (h ^ (unsigned)v.ti) * 0xC2B2AE3D27D4EB4Full;
+        h = (h ^ (unsigned)v.ni) * 0x165667B19E3779F9ull;
+        return (size_t)(h ^ (h >> 32));
+    }
+};
+
+static bool operator==(const vertIndices& a, const vertIndices& b) { return a.vi == b.vi && a.ti == b.ti && a.ni == b.ni; }
+
+void ModelImporter::buildIndexedMesh() {
+    auto startTime = chrono::steady_clock::now();
+
+    uniqueVerts.clear();
+    uniqueTexCoords.clear();
+    uniqueNormals.clear();
+    indices.resize(vertIndexList.size());
+
+    // vertices are numbered in the order they are first used, so the result is always the same
+    std::unordered_map<vertIndices, unsigned int, VertIndicesHash> lookup;
+    lookup.reserve(vertIndexList.size() / 2);
+
+    for (size_t i = 0; i < vertIndexList.size(); i++) {
+        auto found = lookup.emplace(vertIndexList[i], (unsigned int)uniqueVerts.size());
+        if (found.second) {
+            vec3 position, normal;
+            vec2 texCoord;
+            corner(i, position, texCoord, normal);
+            uniqueVerts.push_back(position);
+            uniqueTexCoords.push_back(texCoord);
+            uniqueNormals.push_back(normal);
+        }
+        indices[i] = found.first->second;
+    }
+
+    if (!importerVerbose)
+        return;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    std::cout << "indexed " << indices.size() << " corners into " << uniqueVerts.size() << " vertices in " << seconds * 1000 << " ms\n";
+}
+
+int ModelImporter::getNumVertices() { return (int)vertIndexList.size(); }
+const std::vector<vec3>& ModelImporter::getVertices() { expandCorners(); return triangleVerts; }
+const std::vector<vec2>& ModelImporter::getTextureCoordinates() { expandCorners(); return textureCoords; }
+const std::vector<vec3>& ModelImporter::getNormals() { expandCorners(); return normals; }
+const std::vector<objMesh>& ModelImporter::getMeshes() const { return meshes; }
+const std::vector<std::string>& ModelImporter::getMaterialLibraries() const { return materialLibs; }
+const std::vector<vec3>& ModelImporter::getIndexedVertices() const { return uniqueVerts; }
+const std::vector<vec2>& ModelImporter::getIndexedTextureCoordinates() const { return uniqueTexCoords; }
+const std::vector<vec3>& ModelImporter::getIndexedNormals() const { return uniqueNormals; }
+const std::vector<unsigned int>& ModelImporter::getIndices() const { return indices; }
+std::vector<unsigned int>& ModelImporter::getIndices() { return indices; }
+
+void ModelImporter::readMTL(const char* filePath, std::vector<mtlRecord>& records) {
+    ifstream fileStream(filePath, ios::in);
+    string line;
+    mtlRecord mtl;
+    bool activeMtl = false;
+
+    if (!fileStream.good())
+        return;
+
+    std::cout << "reading material descriptions from " << filePath << "\n";
+    while (getline(fileStream, line)) {
+        std::istringstream nStream(line);
+        string attrib, val;
+        nStream >> attrib;
+
+        if (attrib == "newmtl") {
+            if (activeMtl)
+                records.push_back(mtl);
+            nStream >> mtl.name;
+            mtl.texture.clear();
+            activeMtl = true;
+        }
+        else if ((attrib == "map_Kd") || (attrib == "map_Ka")) {
+            nStream >> val;
+            if (val.compare(0, 1, "-") == 0) {
+                nStream >> val;
+                nStream >> val;
+            }
+            mtl.texture = val;
+            mtl.texturePath = getPathName(filePath) + val;
+        }
+        else if (attrib == "Kd") {
+            float r, g, b;
+            nStream >> r >> g >> b;
+            mtl.color = glm::vec4(r, g, b, 1.0);
+        }
+    }
+    if (activeMtl)
+        records.push_back(mtl);
+}
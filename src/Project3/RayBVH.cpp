@@ -0,0 +1,185 @@
+//
+// BVH construction for the CPU ray tracer
+// binned surface area heuristic, see RayTracing.h for the traversal
+//
+
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+#define BVH_MAX_DEPTH 40 // past this we stop trusting SAH and split at the median to keep traversal stacks small
+
+struct BVHBuildRange {
+    unsigned node, start, count, depth;
+};
+
+static float axisOf(const Vec3f& v, int axis) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); }
+
+void BVH::build(const std::vector<AABB>& bounds)
+{
+    nodes.clear();
+    order.resize(bounds.size());
+    depth = 0;
+
+    if (bounds.empty())
+        return;
+
+    std::vector<Vec3f> centroids(bounds.size());
+
+    for (unsigned i = 0; i < bounds.size(); i++) {
+        order[i] = i;
+        centroids[i] = bounds[i].centroid();
+    }
+
+    nodes.reserve(2 * bounds.size());
+    nodes.push_back(BVHNode());
+
+    std::vector<BVHBuildRange> todo;
+    todo.push_back({ 0, 0, (unsigned)bounds.size(), 0 });
+
+    while (!todo.empty()) {
+        BVHBuildRange r = todo.back();
+        todo.pop_back();
+
+        AABB box, centroidBox;
+        for (unsigned i = r.start; i < r.start + r.count; i++) {
+            box.expand(bounds[order[i]]);
+            centroidBox.expand(centroids[order[i]]);
+        }
+        nodes[r.node].bounds = box;
+        nodes[r.node].start = r.start;
+        nodes[r.node].count = r.count;
+        depth = std::max(depth, r.depth);
+
+        // past BVH_MAX_DEPTH the median splits halve the ranges, so only tens of millions of primitives get here,
+        // their leaves just hold more of them
+        if (r.count <= BVH_MAX_LEAF || r.depth + 1 >= BVH_STACK_SIZE)
+            continue;
+
+        // split along the axis where the centroids are spread out the most
+        Vec3f extent = centroidBox.bmax - centroidBox.bmin;
+        int axis = 0;
+        if (extent.y > extent.x) axis = 1;
+        if (extent.z > axisOf(extent, axis)) axis = 2;
+
+        float cmin = axisOf(centroidBox.bmin, axis), cext = axisOf(extent, axis);
+
+        if (cext <= 0) // every centroid in the same place, nothing to split
+            continue;
+
+        unsigned mid = r.start;
+        unsigned* first = &order[r.start];
+        unsigned* last = first + r.count;
+
+        if (r.depth < BVH_MAX_DEPTH) {
+            AABB binBox[BVH_BINS];
+            unsigned binCount[BVH_BINS] = { 0 };
+            float scale = BVH_BINS / cext;
+
+            auto binOf = [&](unsigned prim) {
+                int b = (int)((axisOf(centroids[prim], axis) - cmin) * scale);
+                return std::min(std::max(b, 0), BVH_BINS - 1);
+            };
+
+            for (unsigned* p = first; p != last; p++) {
+                int b = binOf(*p);
+                binBox[b].expand(bounds[*p]);
+                binCount[b]++;
+            }
+
+            // sweep from the right, then from the left, to cost every split plane
+            float rightArea[BVH_BINS];
+            unsigned rightCount[BVH_BINS];
+            AABB acc;
+            unsigned n = 0;
+            for (int b = BVH_BINS - 1; b > 0; b--) {
+                acc.expand(binBox[b]);
+                n += binCount[b];
+                rightArea[b] = acc.surfaceArea();
+                rightCount[b] = n;
+            }
+
+            float bestCost = INFINITY;
+            int bestSplit = -1;
+            acc = AABB();
+            n = 0;
+            for (int b = 0; b < BVH_BINS - 1; b++) {
+                acc.expand(binBox[b]);
+                n += binCount[b];
+                if (n == 0 || rightCount[b + 1] == 0)
+                    continue;
+                float cost = acc.surfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = b;
+                }
+            }
+
+            // a leaf costs one test per primitive, an interior node a traversal step plus its children
+            float leafCost = box.surfaceArea() * r.count;
+            bestCost = box.surfaceArea() * 0.125f + bestCost;
+
+            if (bestSplit >= 0 && bestCost >= leafCost && r.count <= 4 * BVH_MAX_LEAF)
+                continue;
+
+            if (bestSplit >= 0)
+                mid = (unsigned)(std::partition(first, last, [&](unsigned prim) { return binOf(prim) <= bestSplit; }) - &order[0]);
+        }
+
+        if (mid == r.start || mid == r.start + r.count) {
+            mid = r.start + r.count / 2;
+            std::nth_element(first, &order[mid], last, [&](unsigned a, unsigned b) {
+                return axisOf(centroids[a], axis) < axisOf(centroids[b], axis);
+                });
+        }
+
+        // children are allocated in pairs so a node only needs to know the first one
+        unsigned left = (unsigned)nodes.size();
+        nodes.push_back(BVHNode());
+        unsigned right = (unsigned)nodes.size();
+        nodes.push_back(BVHNode());
+
+        nodes[r.node].start = left;
+        nodes[r.node].count = 0;
+
+        todo.push_back({ right, mid, r.start + r.count - mid, r.depth + 1 });
+        todo.push_back({ left, r.start, mid - r.start, r.depth + 1 });
+    }
+}
+
+void RayScene::build()
+{
+    std::vector<AABB> bounds(spheres.size());
+
+    lights.clear();
+
+    for (unsigned i = 0; i < spheres.size(); i++) {
+        if (spheres[i].emissionColor.x > 0)
+            lights.push_back(i);
+
+        bounds[i].expand(spheres[i].center - Vec3f(spheres[i].radius));
+        bounds[i].expand(spheres[i].center + Vec3f(spheres[i].radius));
+    }
+    bvh.build(bounds);
+    soa.build(spheres, bvh.order);
+
+    std::vector<AABB> triangleBounds(triangles.size());
+
+    for (unsigned i = 0; i < triangles.size(); i++) {
+        triangleBounds[i].expand(triangles[i].v0);
+        triangleBounds[i].expand(triangles[i].v1);
+        triangleBounds[i].expand(triangles[i].v2);
+    }
+    triangleBVH.build(triangleBounds);
+
+    // store the triangles in leaf order so a leaf is a contiguous run of them
+    std::vector<RayTriangle> sorted(triangles.size());
+    for (unsigned i = 0; i < triangles.size(); i++) {
+        sorted[i] = triangles[triangleBVH.order[i]];
+        triangleBVH.order[i] = i;
+    }
+    triangles.swap(sorted);
+}
@@ -0,0 +1,138 @@
+//
+// triangle meshes for the CPU ray tracer
+// the triangles come from the same arrays ModelImporter hands the rasterizer, see RayMeshImport.cpp
+//
+
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing.h"
+
+// corner i of the mesh is vertex vertex(i), positions and normals hold stride floats per vertex
+template <typename VertexOf>
+static unsigned addTriangles(RayScene& scene, const float* positions, const float* normals, unsigned stride, unsigned cornerCount,
+    VertexOf vertex, const RayMesh& material, const float* modelMatrix)
+{
+    static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+    const float* m = modelMatrix ? modelMatrix : identity;
+
+    Vec3f c0(m[0], m[1], m[2]), c1(m[4], m[5], m[6]), c2(m[8], m[9], m[10]), offset(m[12], m[13], m[14]);
+    // normals go through the cofactor matrix, which is the inverse transpose up to a scale
+    Vec3f n0 = c1.cross(c2), n1 = c2.cross(c0), n2 = c0.cross(c1);
+
+    auto point = [&](unsigned i) {
+        const float* p = positions + (size_t)stride * vertex(i);
+        return c0 * p[0] + c1 * p[1] + c2 * p[2] + offset;
+    };
+    auto normal = [&](unsigned i) {
+        if (normals == NULL)
+            return Vec3f(0);
+        const float* n = normals + (size_t)stride * vertex(i);
+        return n0 * n[0] + n1 * n[1] + n2 * n[2];
+    };
+
+    unsigned mesh = (unsigned)scene.meshes.size();
+    scene.meshes.push_back(material);
+
+    scene.triangles.reserve(scene.triangles.size() + cornerCount / 3);
+
+    for (unsigned i = 0; i + 2 < cornerCount; i += 3) {
+        RayTriangle tri;
+        tri.v0 = point(i), tri.v1 = point(i + 1), tri.v2 = point(i + 2);
+        tri.n0 = normal(i), tri.n1 = normal(i + 1), tri.n2 = normal(i + 2);
+        tri.mesh = mesh;
+        scene.triangles.push_back(tri);
+    }
+    return mesh;
+}
+
+unsigned RayScene::addMesh(const float* positions, const float* normals, unsigned vertexCount, const RayMesh& material, const float* modelMatrix)
+{
+    return addTriangles(*this, positions, normals, 3, vertexCount, [](unsigned i) { return i; }, material, modelMatrix);
+}
+
+unsigned RayScene::addIndexedMesh(const float* positions, const float* normals, unsigned stride, const void* indices, unsigned indexSize,
+    unsigned indexCount, const RayMesh& material, const float* modelMatrix)
+{
+    if (indexSize == sizeof(unsigned short)) {
+        const unsigned short* index = (const unsigned short*)indices;
+        return addTriangles(*this, positions, normals, stride, indexCount, [=](unsigned i) { return (unsigned)index[i]; }, material, modelMatrix);
+    }
+    const unsigned* index = (const unsigned*)indices;
+    return addTriangles(*this, positions, normals, stride, indexCount, [=](unsigned i) { return index[i]; }, material, modelMatrix);
+}
+
+RaySurface RayScene::surface(int hit, const Vec3f& phit) const
+{
+    RaySurface s;
+
+    if (hit < (int)spheres.size()) {
+        const Sphere& sphere = spheres[hit];
+        s.normal = phit - sphere.center;
+        s.surfaceColor = sphere.surfaceColor;
+        s.emissionColor = sphere.emissionColor;
+        s.transparency = sphere.transparency;
+        s.reflection = sphere.reflection;
+    }
+    else {
+        const RayTriangle& tri = triangles[hit - spheres.size()];
+        const RayMesh& mesh = meshes[tri.mesh];
+
+        Vec3f e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0;
+        Vec3f geometric = e1.cross(e2);
+
+        if (tri.n0.length2() > 0 && tri.n1.length2() > 0 && tri.n2.length2() > 0) {
+            // barycentric weights of the hit point, from the areas of the sub triangles
+            Vec3f p = phit - tri.v0;
+            float area2 = geometric.length2();
+            float b1 = p.cross(e2).dot(geometric) / area2;
+            float b2 = e1.cross(p).dot(geometric) / area2;
+            s.normal = tri.n0 * (1 - b1 - b2) + tri.n1 * b1 + tri.n2 * b2;
+        }
+        else
+            s.normal = geometric;
+
+        s.surfaceColor = mesh.surfaceColor;
+        s.emissionColor = mesh.emissionColor;
+        s.transparency = mesh.transparency;
+        s.reflection = mesh.reflection;
+    }
+    s.normal.normalize();
+    return s;
+}
+
+void closestTriangle(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, int& hit)
+{
+    if (scene.triangles.empty())
+        return;
+
+    WatertightRay ray(rayorig, raydir);
+    int base = (int)scene.spheres.size();
+
+    // build() put the triangles in BVH order, so a leaf's run indexes them directly
+    scene.triangleBVH.nearest(rayorig, raydir, tnear, [&](unsigned first, unsigned count, float& tmax) {
+        for (unsigned i = first; i < first + count; i++) {
+            float t;
+            if (ray.intersect(scene.triangles[i], tmax, t)) {
+                tmax = t;
+                hit = base + (int)i;
+            }
+        }
+        });
+}
+
+bool anyTriangle(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float tmax)
+{
+    if (scene.triangles.empty())
+        return false;
+
+    WatertightRay ray(rayorig, raydir);
+
+    return scene.triangleBVH.any(rayorig, raydir, tmax, [&](unsigned first, unsigned count) {
+        float t;
+        for (unsigned i = first; i < first + count; i++)
+            if (ray.intersect(scene.triangles[i], tmax, t))
+                return true;
+        return false;
+        });
+}
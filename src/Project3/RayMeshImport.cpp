@@ -0,0 +1,75 @@
+//
+// feeds models loaded by ModelImporter to the CPU ray tracer
+// this is the only ray tracer file that sees glm, the rest of it stays free of GL headers
+//
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <string>
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include "ImportedModel.h"
+#include "RayTracing.h"
+
+// loads an OBJ with the rasterizer's importer and adds its triangles to scene as one mesh
+// the MTL files aren't read (they create GL materials), the whole model gets material instead
+// returns false when the file had no triangles
+bool addOBJToRayScene(RayScene& scene, const char* filePath, const RayMesh& material, const float* modelMatrix)
+{
+    ModelImporter importer;
+    importer.parseOBJ(filePath);
+
+    // the shared vertices, the per corner copies are never built
+    importer.buildIndexedMesh();
+    importer.releaseCorners();
+
+    const std::vector<glm::vec3>& verts = importer.getIndexedVertices();
+    const std::vector<glm::vec3>& normals = importer.getIndexedNormals();
+    const std::vector<unsigned int>& indices = importer.getIndices();
+
+    if (indices.size() < 3) {
+        std::cout << "no triangles to ray trace in " << filePath << "\n";
+        return false;
+    }
+    scene.addIndexedMesh(glm::value_ptr(verts[0]), glm::value_ptr(normals[0]), 3, indices.data(), sizeof(unsigned int),
+        (unsigned)indices.size(), material, modelMatrix);
+
+    if (importerVerbose)
+        std::cout << "ray tracing " << indices.size() / 3 << " triangles from " << filePath << "\n";
+    return true;
+}
+
+// an indexed mesh as ObjModel has it (position, normal and texture coordinate in floatsPerVertex floats), seen from
+// the sandbox camera and lit by a sphere light floating above it, ready to trace
+// NULL when there are no triangles, nothing in here needs the render thread
+RayScene* rayTraceScene(const float* vertices, unsigned floatsPerVertex, const void* indices, unsigned indexSize, unsigned indexCount,
+    const float* modelMatrix, const float* eye, const float* target, float fov)
+{
+    if (indexCount < 3)
+        return NULL;
+
+    RayScene* scene = new RayScene();
+    scene->addIndexedMesh(vertices, vertices + 3, floatsPerVertex, indices, indexSize, indexCount, RayMesh(), modelMatrix);
+
+    AABB box;
+    for (const RayTriangle& tri : scene->triangles) {
+        box.expand(tri.v0);
+        box.expand(tri.v1);
+        box.expand(tri.v2);
+    }
+    Vec3f center = box.centroid();
+    float size = (box.bmax - box.bmin).length();
+
+    // position, radius, surface color, reflectivity, transparency, emission color
+    scene->spheres.push_back(Sphere(Vec3f(center.x, box.bmax.y + size * 0.5f, center.z), size * 0.1f, Vec3f(0), 0, 0, Vec3f(3)));
+
+    scene->camera.position = Vec3f(eye[0], eye[1], eye[2]);
+    scene->camera.target = Vec3f(target[0], target[1], target[2]);
+    scene->camera.fov = fov;
+
+    scene->build();
+    return scene;
+}
@@ -0,0 +1,386 @@
+//
+// SIMD ray / sphere kernels for the CPU ray tracer
+//
+// the scene keeps a structure of arrays copy of the spheres (SphereSoA) so SSE can test one ray against
+// 4 spheres at a time and AVX2 against 8, or 4 / 8 rays of a packet against one sphere
+// every kernel does the same float operations in the same order as Sphere::intersect, so all of them
+// produce the same hits as the scalar code
+//
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+#include "RayTracing.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RT_TARGET_AVX2
+#else
+#define RT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define SOA_PADDING 8    // one AVX register, a kernel's last aligned load starts at most 7 entries before the end
+
+void SphereSoA::build(const std::vector<Sphere>& spheres, const std::vector<unsigned>& order)
+{
+    size_t n = order.size();
+
+    // padding entries can never be hit since d2 >= 0 > radius2
+    cx.assign(n + SOA_PADDING, 0.0f);
+    cy.assign(n + SOA_PADDING, 0.0f);
+    cz.assign(n + SOA_PADDING, 0.0f);
+    radius2.assign(n + SOA_PADDING, -1.0f);
+    index = order;
+
+    for (size_t i = 0; i < n; i++) {
+        const Sphere& s = spheres[order[i]];
+        cx[i] = s.center.x;
+        cy[i] = s.center.y;
+        cz[i] = s.center.z;
+        radius2[i] = s.radius2;
+    }
+}
+
+// ---------------------------------------------------------------
+// scalar reference kernels
+
+static int nearestScalar(const SphereSoA& soa, unsigned first, unsigned count, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, unsigned skip)
+{
+    int best = -1;
+
+    for (unsigned i = first; i < first + count; i++) {
+        if (soa.index[i] == skip) continue;
+
+        Vec3f l = Vec3f(soa.cx[i], soa.cy[i], soa.cz[i]) - rayorig;
+        float tca = l.dot(raydir);
+        if (tca < 0) continue;
+        float d2 = l.dot(l) - tca * tca;
+        if (d2 > soa.radius2[i]) continue;
+        float thc = sqrt(soa.radius2[i] - d2);
+        float t = tca - thc;
+        if (t < 0) t = tca + thc;
+        if (t < tnear) {
+            tnear = t;
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void packetScalar(const SphereSoA& soa, unsigned i, RayPacket& p)
+{
+    for (unsigned k = 0; k < 4; k++) {
+        Vec3f l = Vec3f(soa.cx[i], soa.cy[i], soa.cz[i]) - Vec3f(p.ox[k], p.oy[k], p.oz[k]);
+        Vec3f d(p.dx[k], p.dy[k], p.dz[k]);
+        float tca = l.dot(d);
+        if (tca < 0) continue;
+        float d2 = l.dot(l) - tca * tca;
+        if (d2 > soa.radius2[i]) continue;
+        float thc = sqrt(soa.radius2[i] - d2);
+        float t = tca - thc;
+        if (t < 0) t = tca + thc;
+        if (t < p.tnear[k]) {
+            p.tnear[k] = t;
+            p.hit[k] = i;
+        }
+    }
+}
+
+static const SphereKernels scalarKernels = { "scalar", 4, nearestScalar, packetScalar };
+
+#ifdef RT_X86
+// ---------------------------------------------------------------
+// SSE : 4 lanes
+
+static int nearestSSE(const SphereSoA& soa, unsigned first, unsigned count, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, unsigned skip)
+{
+    const __m128 ox = _mm_set1_ps(rayorig.x), oy = _mm_set1_ps(rayorig.y), oz = _mm_set1_ps(rayorig.z);
+    const __m128 dx = _mm_set1_ps(raydir.x), dy = _mm_set1_ps(raydir.y), dz = _mm_set1_ps(raydir.z);
+    const __m128 zero = _mm_setzero_ps();
+    int best = -1;
+
+    // start on the register before first so every load is aligned, the lanes ahead of first are skipped below
+    for (unsigned i = first & ~3u; i < first + count; i += 4) {
+        __m128 lx = _mm_sub_ps(_mm_load_ps(&soa.cx[i]), ox);
+        __m128 ly = _mm_sub_ps(_mm_load_ps(&soa.cy[i]), oy);
+        __m128 lz = _mm_sub_ps(_mm_load_ps(&soa.cz[i]), oz);
+        __m128 r2 = _mm_load_ps(&soa.radius2[i]);
+
+        __m128 tca = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, dx), _mm_mul_ps(ly, dy)), _mm_mul_ps(lz, dz));
+        __m128 ll = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+        __m128 d2 = _mm_sub_ps(ll, _mm_mul_ps(tca, tca));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(tca, zero), _mm_cmple_ps(d2, r2)));
+        if (mask == 0) continue;
+
+        __m128 thc = _mm_sqrt_ps(_mm_sub_ps(r2, d2));
+        __m128 t0 = _mm_sub_ps(tca, thc), t1 = _mm_add_ps(tca, thc);
+        __m128 behind = _mm_cmplt_ps(t0, zero);
+        __m128 t = _mm_or_ps(_mm_and_ps(behind, t1), _mm_andnot_ps(behind, t0));
+
+        alignas(16) float tl[4];
+        _mm_store_ps(tl, t);
+
+        // resolve lanes in order so ties go to the same sphere as in the scalar loop
+        for (unsigned k = 0; k < 4 && i + k < first + count; k++) {
+            if (i + k >= first && (mask & (1 << k)) && soa.index[i + k] != skip && tl[k] < tnear) {
+                tnear = tl[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+static void packetSSE(const SphereSoA& soa, unsigned i, RayPacket& p)
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 lx = _mm_sub_ps(_mm_set1_ps(soa.cx[i]), _mm_load_ps(p.ox));
+    __m128 ly = _mm_sub_ps(_mm_set1_ps(soa.cy[i]), _mm_load_ps(p.oy));
+    __m128 lz = _mm_sub_ps(_mm_set1_ps(soa.cz[i]), _mm_load_ps(p.oz));
+    __m128 r2 = _mm_set1_ps(soa.radius2[i]);
+
+    __m128 tca = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_load_ps(p.dx)), _mm_mul_ps(ly, _mm_load_ps(p.dy))), _mm_mul_ps(lz, _mm_load_ps(p.dz)));
+    __m128 ll = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+    __m128 d2 = _mm_sub_ps(ll, _mm_mul_ps(tca, tca));
+
+    __m128 valid = _mm_and_ps(_mm_cmpge_ps(tca, zero), _mm_cmple_ps(d2, r2));
+    if (_mm_movemask_ps(valid) == 0) return;
+
+    __m128 thc = _mm_sqrt_ps(_mm_sub_ps(r2, d2));
+    __m128 t0 = _mm_sub_ps(tca, thc), t1 = _mm_add_ps(tca, thc);
+    __m128 behind = _mm_cmplt_ps(t0, zero);
+    __m128 t = _mm_or_ps(_mm_and_ps(behind, t1), _mm_andnot_ps(behind, t0));
+
+    __m128 tnear = _mm_load_ps(p.tnear);
+    __m128 closer = _mm_and_ps(valid, _mm_cmplt_ps(t, tnear));
+    int mask = _mm_movemask_ps(closer);
+    if (mask == 0) return;
+
+    _mm_store_ps(p.tnear, _mm_or_ps(_mm_and_ps(closer, t), _mm_andnot_ps(closer, tnear)));
+    for (unsigned k = 0; k < 4; k++)
+        if (mask & (1 << k)) p.hit[k] = i;
+}
+
+static const SphereKernels sseKernels = { "sse", 4, nearestSSE, packetSSE };
+
+// ---------------------------------------------------------------
+// AVX2 : 8 lanes
+
+RT_TARGET_AVX2 static int nearestAVX2(const SphereSoA& soa, unsigned first, unsigned count, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, unsigned skip)
+{
+    const __m256 ox = _mm256_set1_ps(rayorig.x), oy = _mm256_set1_ps(rayorig.y), oz = _mm256_set1_ps(rayorig.z);
+    const __m256 dx = _mm256_set1_ps(raydir.x), dy = _mm256_set1_ps(raydir.y), dz = _mm256_set1_ps(raydir.z);
+    const __m256 zero = _mm256_setzero_ps();
+    int best = -1;
+
+    for (unsigned i = first & ~7u; i < first + count; i += 8) {
+        __m256 lx = _mm256_sub_ps(_mm256_load_ps(&soa.cx[i]), ox);
+        __m256 ly = _mm256_sub_ps(_mm256_load_ps(&soa.cy[i]), oy);
+        __m256 lz = _mm256_sub_ps(_mm256_load_ps(&soa.cz[i]), oz);
+        __m256 r2 = _mm256_load_ps(&soa.radius2[i]);
+
+        __m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, dx), _mm256_mul_ps(ly, dy)), _mm256_mul_ps(lz, dz));
+        __m256 ll = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+        __m256 d2 = _mm256_sub_ps(ll, _mm256_mul_ps(tca, tca));
+
+        int mask = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(tca, zero, _CMP_GE_OQ), _mm256_cmp_ps(d2, r2, _CMP_LE_OQ)));
+        if (mask == 0) continue;
+
+        __m256 thc = _mm256_sqrt_ps(_mm256_sub_ps(r2, d2));
+        __m256 t0 = _mm256_sub_ps(tca, thc), t1 = _mm256_add_ps(tca, thc);
+        __m256 t = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, zero, _CMP_LT_OQ));
+
+        alignas(32) float tl[8];
+        _mm256_store_ps(tl, t);
+
+        for (unsigned k = 0; k < 8 && i + k < first + count; k++) {
+            if (i + k >= first && (mask & (1 << k)) && soa.index[i + k] != skip && tl[k] < tnear) {
+                tnear = tl[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+RT_TARGET_AVX2 static void packetAVX2(const SphereSoA& soa, unsigned i, RayPacket& p)
+{
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 lx = _mm256_sub_ps(_mm256_set1_ps(soa.cx[i]), _mm256_load_ps(p.ox));
+    __m256 ly = _mm256_sub_ps(_mm256_set1_ps(soa.cy[i]), _mm256_load_ps(p.oy));
+    __m256 lz = _mm256_sub_ps(_mm256_set1_ps(soa.cz[i]), _mm256_load_ps(p.oz));
+    __m256 r2 = _mm256_set1_ps(soa.radius2[i]);
+
+    __m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, _mm256_load_ps(p.dx)), _mm256_mul_ps(ly, _mm256_load_ps(p.dy))), _mm256_mul_ps(lz, _mm256_load_ps(p.dz)));
+    __m256 ll = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+    __m256 d2 = _mm256_sub_ps(ll, _mm256_mul_ps(tca, tca));
+
+    __m256 valid = _mm256_and_ps(_mm256_cmp_ps(tca, zero, _CMP_GE_OQ), _mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(valid) == 0) return;
+
+    __m256 thc = _mm256_sqrt_ps(_mm256_sub_ps(r2, d2));
+    __m256 t0 = _mm256_sub_ps(tca, thc), t1 = _mm256_add_ps(tca, thc);
+    __m256 t = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, zero, _CMP_LT_OQ));
+
+    __m256 tnear = _mm256_load_ps(p.tnear);
+    __m256 closer = _mm256_and_ps(valid, _mm256_cmp_ps(t, tnear, _CMP_LT_OQ));
+    int mask = _mm256_movemask_ps(closer);
+    if (mask == 0) return;
+
+    _mm256_store_ps(p.tnear, _mm256_blendv_ps(tnear, t, closer));
+    for (unsigned k = 0; k < 8; k++)
+        if (mask & (1 << k)) p.hit[k] = i;
+}
+
+static const SphereKernels avx2Kernels = { "avx2", 8, nearestAVX2, packetAVX2 };
+
+static bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // the OS also has to save the ymm registers for us
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+std::vector<const SphereKernels*> SphereKernels::available()
+{
+    std::vector<const SphereKernels*> kernels = { &scalarKernels };
+#ifdef RT_X86
+    kernels.push_back(&sseKernels);
+    if (cpuHasAVX2())
+        kernels.push_back(&avx2Kernels);
+#endif
+    return kernels;
+}
+
+const SphereKernels& SphereKernels::best()
+{
+    static const SphereKernels* kernels = available().back();
+    return *kernels;
+}
+
+// ---------------------------------------------------------------
+
+int closestHit(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float& tnear)
+{
+    int hit = -1;
+
+    threadRayCount++;
+    scene.bvh.nearest(rayorig, raydir, tnear, [&](unsigned first, unsigned count, float& tmax) {
+        int h = scene.kernels->nearest(scene.soa, first, count, rayorig, raydir, tmax, ~0u);
+        if (h >= 0) hit = h;
+        });
+
+    hit = hit < 0 ? -1 : (int)scene.soa.index[hit];
+    closestTriangle(scene, rayorig, raydir, tnear, hit);
+
+    return hit;
+}
+
+bool occluded(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float tmax, unsigned skip)
+{
+    threadRayCount++;
+    // the first blocker will do, the kernel only has to beat tmax rather than find the nearest
+    if (scene.bvh.any(rayorig, raydir, tmax, [&](unsigned first, unsigned count) {
+        float t = tmax;
+        return scene.kernels->nearest(scene.soa, first, count, rayorig, raydir, t, skip) >= 0;
+        }))
+        return true;
+    return anyTriangle(scene, rayorig, raydir, tmax);
+}
+
+void closestHitPacket(const RayScene& scene, RayPacket& p)
+{
+    unsigned width = scene.kernels->packetWidth;
+
+    threadRayCount += width;
+    for (unsigned k = 0; k < width; k++)
+        p.hit[k] = -1;
+
+    scene.bvh.nearestPacket(p, width, [&](unsigned first, unsigned count) {
+        for (unsigned i = first; i < first + count; i++)
+            scene.kernels->packet(scene.soa, i, p);
+        });
+
+    for (unsigned k = 0; k < width; k++)
+        if (p.hit[k] >= 0) p.hit[k] = scene.soa.index[p.hit[k]];
+
+    // triangles are traced one ray at a time
+    if (!scene.triangles.empty())
+        for (unsigned k = 0; k < width; k++)
+            closestTriangle(scene, Vec3f(p.ox[k], p.oy[k], p.oz[k]), Vec3f(p.dx[k], p.dy[k], p.dz[k]), p.tnear[k], p.hit[k]);
+}
+
+void benchmarkSphereKernels(const RayScene& scene, unsigned width, unsigned height)
+{
+    float invWidth = 1 / float(width), invHeight = 1 / float(height);
+    float fov = scene.camera.fov, aspectratio = width / float(height);
+    float angle = tan(M_PI * 0.5 * fov / 180.);
+    Vec3f eye = scene.camera.position, right, up, forward;
+    scene.camera.basis(right, up, forward);
+
+    std::vector<Vec3f> dirs(width * height);
+    for (unsigned y = 0; y < height; ++y)
+        for (unsigned x = 0; x < width; ++x) {
+            float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
+            float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
+            dirs[y * width + x] = (right * xx + up * yy + forward).normalize();
+        }
+
+    std::cout << "sphere kernel benchmark, " << scene.spheres.size() << " spheres, " << dirs.size() << " primary rays\n";
+
+    RayScene bench = scene;
+    unsigned checksum = 0;
+
+    for (const SphereKernels* k : SphereKernels::available()) {
+        bench.kernels = k;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const Vec3f& d : dirs) {
+            float tnear = INFINITY;
+            checksum += closestHit(bench, eye, d, tnear);
+        }
+        auto middle = std::chrono::high_resolution_clock::now();
+
+        RayPacket p;
+        for (size_t i = 0; i < dirs.size(); i += k->packetWidth) {
+            for (unsigned j = 0; j < k->packetWidth; j++) {
+                const Vec3f& d = dirs[std::min(i + j, dirs.size() - 1)];
+                p.ox[j] = eye.x, p.oy[j] = eye.y, p.oz[j] = eye.z;
+                p.dx[j] = d.x, p.dy[j] = d.y, p.dz[j] = d.z;
+                p.tnear[j] = INFINITY;
+            }
+            closestHitPacket(bench, p);
+            checksum += p.hit[0];
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double single = std::chrono::duration<double>(middle - start).count();
+        double packet = std::chrono::duration<double>(end - middle).count();
+
+        std::cout << "  " << k->name << "\t1 ray x " << (k == &scalarKernels ? 1 : k->packetWidth) << " spheres : " << dirs.size() / single / 1e6 << " Mrays/s"
+            << "\t" << k->packetWidth << " ray packets : " << dirs.size() / packet / 1e6 << " Mrays/s\n";
+    }
+    std::cout << "  (checksum " << checksum << ")\n";
+}
@@ -6,221 +6,386 @@
 #include <iostream> 
 #include <cassert> 
 
-#if defined __linux__ || defined __APPLE__ 
-// "Compiled for Linux
-#else 
-// Windows doesn't define these values by default, Linux does
-#define M_PI 3.141592653589793 
-#define INFINITY 1e8 
-#endif 
-
-template<typename T>
-class Vec3
-{
-public:
-    T x, y, z;
-    Vec3() : x(T(0)), y(T(0)), z(T(0)) {}
-    Vec3(T xx) : x(xx), y(xx), z(xx) {}
-    Vec3(T xx, T yy, T zz) : x(xx), y(yy), z(zz) {}
-    Vec3& normalize()
-    {
-        T nor2 = length2();
-        if (nor2 > 0) {
-            T invNor = 1 / sqrt(nor2);
-            x *= invNor, y *= invNor, z *= invNor;
-        }
-        return *this;
-    }
-    Vec3<T> operator * (const T& f) const { return Vec3<T>(x * f, y * f, z * f); }
-    Vec3<T> operator * (const Vec3<T>& v) const { return Vec3<T>(x * v.x, y * v.y, z * v.z); }
-    T dot(const Vec3<T>& v) const { return x * v.x + y * v.y + z * v.z; }
-    Vec3<T> operator - (const Vec3<T>& v) const { return Vec3<T>(x - v.x, y - v.y, z - v.z); }
-    Vec3<T> operator + (const Vec3<T>& v) const { return Vec3<T>(x + v.x, y + v.y, z + v.z); }
-    Vec3<T>& operator += (const Vec3<T>& v) { x += v.x, y += v.y, z += v.z; return *this; }
-    Vec3<T>& operator *= (const Vec3<T>& v) { x *= v.x, y *= v.y, z *= v.z; return *this; }
-    Vec3<T> operator - () const { return Vec3<T>(-x, -y, -z); }
-    T length2() const { return x * x + y * y + z * z; }
-    T length() const { return sqrt(length2()); }
-    friend std::ostream& operator << (std::ostream& os, const Vec3<T>& v)
-    {
-        os << "[" << v.x << " " << v.y << " " << v.z << "]";
-        return os;
-    }
-};
+#include "ThreadPool.h"
+#include "RayTracing.h"
 
-typedef Vec3<float> Vec3f;
-
-class Sphere
-{
-public:
-    Vec3f center;                           /// position of the sphere 
-    float radius, radius2;                  /// sphere radius and radius^2 
-    Vec3f surfaceColor, emissionColor;      /// surface color and emission (light) 
-    float transparency, reflection;         /// surface transparency and reflectivity 
-    Sphere(
-        const Vec3f& c,
-        const float& r,
-        const Vec3f& sc,
-        const float& refl = 0,
-        const float& transp = 0,
-        const Vec3f& ec = 0) :
-        center(c), radius(r), radius2(r* r), surfaceColor(sc), emissionColor(ec),
-        transparency(transp), reflection(refl)
-    { /* empty */
-    }
-
-    bool intersect(const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const
-    {
-        Vec3f l = center - rayorig;
-        float tca = l.dot(raydir);
-        if (tca < 0) return false;
-        float d2 = l.dot(l) - tca * tca;
-        if (d2 > radius2) return false;
-        float thc = sqrt(radius2 - d2);
-        t0 = tca - thc;
-        t1 = tca + thc;
-
-        return true;
-    }
-};
+#define MAX_RAY_DEPTH 5 
 
+thread_local unsigned long long threadRayCount = 0;
+static std::atomic<unsigned long long> totalRayCount{ 0 };
 
-#define MAX_RAY_DEPTH 5 
+unsigned long long rayTracerRayCount() { return totalRayCount; }
 
 float mix(const float& a, const float& b, const float& mix)
 {
     return b * mix + a * (1 - mix);
 }
 
+// a ray still waiting to be traced, weight is how much of its colour reaches the pixel
+struct PendingRay {
+    Vec3f orig, dir, weight;
+    int depth;
+};
+
+// every hit pushes at most a reflection and a refraction ray and we always pop the newest one,
+// so the stack never holds more than one waiting ray per bounce plus the two just pushed
+#define RAY_STACK_SIZE (2 * MAX_RAY_DEPTH + 2)
+
+// rays that would change the pixel by less than this are dropped, the dropped rays of a
+// pixel add up to less than one 8 bit step in the demo scene
+#define RAY_MIN_WEIGHT 3e-4f
+
+// light reaching a diffuse surface point straight from the emissive spheres
+Vec3f directLight(const RayScene& scene, const RaySurface& surface, const Vec3f& phit, const Vec3f& nhit, float bias)
+{
+    const std::vector<Sphere>& spheres = scene.spheres;
+    Vec3f diffuse = 0;
+    for (unsigned i : scene.lights) {
+        // this is a light
+        Vec3f transmission = 1;
+        Vec3f lightDirection = spheres[i].center - phit;
+        lightDirection.normalize();
+        float cosine = nhit.dot(lightDirection);
+        if (cosine <= 0) // behind the surface, it adds nothing whether it is blocked or not
+            continue;
+        // anything other than the light itself blocks it, as long as it is in front of the light
+        Vec3f shadoworig = phit + nhit * bias;
+        float lightDistance = (spheres[i].center - shadoworig).length() - spheres[i].radius;
+        if (occluded(scene, shadoworig, lightDirection, lightDistance, i))
+            transmission = 0;
+        diffuse += surface.surfaceColor * transmission * cosine * spheres[i].emissionColor;
+    }
+    return diffuse;
+}
+
+// colour seen along a ray that hit primitive hit at distance tnear (hit < 0 for a miss)
+// the reflection and refraction rays spawned on the way are traced iteratively from a
+// fixed size stack instead of recursing, each carrying the product of the fresnel terms
+// and surface colours above it
+Vec3f shade(
+    const Vec3f& rayorig,
+    const Vec3f& raydir,
+    const RayScene& scene,
+    int hit,
+    float tnear)
+{
+    PendingRay stack[RAY_STACK_SIZE];
+    int top = 0;
+    Vec3f color = 0;
+
+    stack[top++] = { rayorig, raydir, Vec3f(1), 0 };
+
+    while (top > 0) {
+        const PendingRay ray = stack[--top];
+
+        // the first ray's hit was found by the caller
+        if (ray.depth > 0) {
+            tnear = INFINITY;
+            hit = closestHit(scene, ray.orig, ray.dir, tnear);
+        }
+        // if there's no intersection return black or background color
+        if (hit < 0) {
+            color += ray.weight * Vec3f(2);
+            continue;
+        }
+        Vec3f phit = ray.orig + ray.dir * tnear; // point of intersection 
+        const RaySurface surface = scene.surface(hit, phit);
+        Vec3f nhit = surface.normal; // normal at the intersection point 
+        // If the normal and the view direction are not opposite to each other
+        // reverse the normal direction. That also means we are inside the sphere so set
+        // the inside bool to true. Finally reverse the sign of IdotN which we want
+        // positive.
+        float bias = 1e-4; // add some bias to the point from which we will be tracing 
+        bool inside = false;
+        if (ray.dir.dot(nhit) > 0) nhit = -nhit, inside = true;
+
+        color += ray.weight * surface.emissionColor;
+
+        if ((surface.transparency > 0 || surface.reflection > 0) && ray.depth < MAX_RAY_DEPTH) {
+            float facingratio = -ray.dir.dot(nhit);
+            // change the mix value to tweak the effect
+            float facing = 1 - facingratio;
+            float fresneleffect = mix(facing * facing * facing, 1, 0.1);
+            // the result is a mix of reflection and refraction (if the sphere is transparent)
+            Vec3f reflectWeight = ray.weight * surface.surfaceColor * fresneleffect;
+            Vec3f refractWeight = ray.weight * surface.surfaceColor * ((1 - fresneleffect) * surface.transparency);
+
+            // if the sphere is also transparent compute refraction ray (transmission)
+            if (surface.transparency && std::max(refractWeight.x, std::max(refractWeight.y, refractWeight.z)) > RAY_MIN_WEIGHT) {
+                float ior = 1.1, eta = (inside) ? ior : 1 / ior; // are we inside or outside the surface? 
+                float cosi = -nhit.dot(ray.dir);
+                float k = 1 - eta * eta * (1 - cosi * cosi);
+                Vec3f refrdir = ray.dir * eta + nhit * (eta * cosi - sqrt(k));
+                refrdir.normalize();
+                stack[top++] = { phit - nhit * bias, refrdir, refractWeight, ray.depth + 1 };
+            }
+            // compute reflection direction (not need to normalize because all vectors
+            // are already normalized)
+            if (std::max(reflectWeight.x, std::max(reflectWeight.y, reflectWeight.z)) > RAY_MIN_WEIGHT) {
+                Vec3f refldir = ray.dir - nhit * 2 * ray.dir.dot(nhit);
+                refldir.normalize();
+                stack[top++] = { phit + nhit * bias, refldir, reflectWeight, ray.depth + 1 };
+            }
+        }
+        else {
+            // it's a diffuse object, no need to raytrace any further
+            color += ray.weight * directLight(scene, surface, phit, nhit, bias);
+        }
+    }
+
+    return color;
+}
+
 Vec3f trace(
     const Vec3f& rayorig,
     const Vec3f& raydir,
-    const std::vector<Sphere>& spheres,
-    const int& depth)
+    const RayScene& scene)
 {
     //if (raydir.length() != 1) std::cerr << "Error " << raydir << std::endl;
     float tnear = INFINITY;
-    const Sphere* sphere = NULL;
-    // find intersection of this ray with the sphere in the scene
-    for (unsigned i = 0; i < spheres.size(); ++i) {
-        float t0 = INFINITY, t1 = INFINITY;
-        if (spheres[i].intersect(rayorig, raydir, t0, t1)) {
-            if (t0 < 0) t0 = t1;
-            if (t0 < tnear) {
-                tnear = t0;
-                sphere = &spheres[i];
-            }
-        }
+    // find the nearest intersection of this ray with the spheres in the scene
+    int hit = closestHit(scene, rayorig, raydir, tnear);
+
+    return shade(rayorig, raydir, scene, hit, tnear);
+}
+
+// small fast random numbers for the path tracer (PCG), every pixel of every pass gets its own sequence
+// so the image doesn't depend on how the tiles were spread over the threads
+struct RayRandom
+{
+    unsigned state;
+    RayRandom(unsigned pixel, unsigned pass) : state(pixel ^ (pass * 0x9E3779B9u)) { next(); next(); }
+    unsigned nextInt()
+    {
+        state = state * 747796405u + 2891336453u;
+        unsigned word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
     }
-    // if there's no intersection return black or background color
-    if (!sphere) return Vec3f(2);
-    Vec3f surfaceColor = 0; // color of the ray/surfaceof the object intersected by the ray 
-    Vec3f phit = rayorig + raydir * tnear; // point of intersection 
-    Vec3f nhit = phit - sphere->center; // normal at the intersection point 
-    nhit.normalize(); // normalize normal direction 
-    // If the normal and the view direction are not opposite to each other
-    // reverse the normal direction. That also means we are inside the sphere so set
-    // the inside bool to true. Finally reverse the sign of IdotN which we want
-    // positive.
-    float bias = 1e-4; // add some bias to the point from which we will be tracing 
-    bool inside = false;
-    if (raydir.dot(nhit) > 0) nhit = -nhit, inside = true;
-    if ((sphere->transparency > 0 || sphere->reflection > 0) && depth < MAX_RAY_DEPTH) {
-        float facingratio = -raydir.dot(nhit);
-        // change the mix value to tweak the effect
-        float fresneleffect = mix(pow(1 - facingratio, 3), 1, 0.1);
-        // compute reflection direction (not need to normalize because all vectors
-        // are already normalized)
-        Vec3f refldir = raydir - nhit * 2 * raydir.dot(nhit);
-        refldir.normalize();
-        Vec3f reflection = trace(phit + nhit * bias, refldir, spheres, depth + 1);
-        Vec3f refraction = 0;
-        // if the sphere is also transparent compute refraction ray (transmission)
-        if (sphere->transparency) {
-            float ior = 1.1, eta = (inside) ? ior : 1 / ior; // are we inside or outside the surface? 
-            float cosi = -nhit.dot(raydir);
-            float k = 1 - eta * eta * (1 - cosi * cosi);
-            Vec3f refrdir = raydir * eta + nhit * (eta * cosi - sqrt(k));
-            refrdir.normalize();
-            refraction = trace(phit - nhit * bias, refrdir, spheres, depth + 1);
+    // uniform in [0, 1)
+    float next() { return (nextInt() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// one random path through the scene, the Monte Carlo counterpart of trace()
+// mirrors and glass pick reflection or refraction at random in proportion to their share,
+// diffuse surfaces add the direct light and then bounce off in a cosine weighted direction
+Vec3f tracePath(Vec3f orig, Vec3f dir, const RayScene& scene, RayRandom& rnd)
+{
+    Vec3f color = 0, weight = 1;
+    bool specular = true; // lights found by a diffuse bounce were already counted by directLight()
+
+    for (int depth = 0; depth <= MAX_RAY_DEPTH; depth++) {
+        float tnear = INFINITY;
+        int hit = closestHit(scene, orig, dir, tnear);
+        if (hit < 0) {
+            color += weight * Vec3f(2);
+            break;
         }
-        // the result is a mix of reflection and refraction (if the sphere is transparent)
-        surfaceColor = (
-            reflection * fresneleffect +
-            refraction * (1 - fresneleffect) * sphere->transparency) * sphere->surfaceColor;
-    }
-    else {
-        // it's a diffuse object, no need to raytrace any further
-        for (unsigned i = 0; i < spheres.size(); ++i) {
-            if (spheres[i].emissionColor.x > 0) {
-                // this is a light
-                Vec3f transmission = 1;
-                Vec3f lightDirection = spheres[i].center - phit;
-                lightDirection.normalize();
-                for (unsigned j = 0; j < spheres.size(); ++j) {
-                    if (i != j) {
-                        float t0, t1;
-                        if (spheres[j].intersect(phit + nhit * bias, lightDirection, t0, t1)) {
-                            transmission = 0;
-                            break;
-                        }
-                    }
-                }
-                surfaceColor += sphere->surfaceColor * transmission *
-                    std::max(float(0), nhit.dot(lightDirection)) * spheres[i].emissionColor;
+        Vec3f phit = orig + dir * tnear;
+        const RaySurface surface = scene.surface(hit, phit);
+        Vec3f nhit = surface.normal;
+        float bias = 1e-4;
+        bool inside = false;
+        if (dir.dot(nhit) > 0) nhit = -nhit, inside = true;
+
+        if (specular)
+            color += weight * surface.emissionColor;
+
+        if ((surface.transparency > 0 || surface.reflection > 0) && depth < MAX_RAY_DEPTH) {
+            float facing = 1 + dir.dot(nhit);
+            float fresneleffect = mix(facing * facing * facing, 1, 0.1);
+            float reflectShare = fresneleffect;
+            float refractShare = surface.transparency ? (1 - fresneleffect) * surface.transparency : 0;
+            weight *= surface.surfaceColor * (reflectShare + refractShare);
+
+            if (rnd.next() * (reflectShare + refractShare) < reflectShare) {
+                dir = dir - nhit * 2 * dir.dot(nhit);
+                orig = phit + nhit * bias;
+            }
+            else {
+                float ior = 1.1, eta = (inside) ? ior : 1 / ior;
+                float cosi = -nhit.dot(dir);
+                float k = 1 - eta * eta * (1 - cosi * cosi);
+                dir = dir * eta + nhit * (eta * cosi - sqrt(k));
+                orig = phit - nhit * bias;
             }
+            dir.normalize();
+            specular = true;
         }
-    }
+        else {
+            color += weight * directLight(scene, surface, phit, nhit, bias);
+            weight *= surface.surfaceColor;
 
-    return surfaceColor + sphere->emissionColor;
+            // cosine weighted direction around the normal, so the weight is just the surface colour
+            Vec3f u = std::fabs(nhit.x) > 0.1f ? Vec3f(nhit.z, 0, -nhit.x) : Vec3f(0, -nhit.z, nhit.y);
+            u.normalize();
+            Vec3f v(nhit.y * u.z - nhit.z * u.y, nhit.z * u.x - nhit.x * u.z, nhit.x * u.y - nhit.y * u.x);
+            float phi = 2 * M_PI * rnd.next(), r2 = rnd.next(), r = sqrt(r2);
+            dir = u * (cos(phi) * r) + v * (sin(phi) * r) + nhit * sqrt(1 - r2);
+            dir.normalize();
+            orig = phit + nhit * bias;
+            specular = false;
+        }
+        if (std::max(weight.x, std::max(weight.y, weight.z)) < RAY_MIN_WEIGHT)
+            break;
+    }
+    return color;
 }
 
-// image buffer used by raster drawing basics.cpp
+// the image is split into square tiles which are handed out to the thread pool
+// a pixel's rays depend only on where it is (its extra antialiasing rays are Halton points), and the
+// neighbours it is compared with are all written before the refining pass starts, so the image is the
+// same whatever the thread count or the order the tiles are taken in
+#define TILE_SIZE 32
 
-extern unsigned char imageBuff[512][512][4];
+// antialiased pixels take their extra rays this many at a time, checking in between whether they can stop
+#define AA_BATCH 4
 
-void render(const std::vector<Sphere>& spheres)
+// radical inverse of i in the given base, the Halton points spread a pixel's extra rays evenly whatever their number
+static double halton(unsigned i, unsigned base)
 {
-    unsigned width = 512, height = 512;
-    
-    Vec3f* image = new Vec3f[width * height], * pixel = image;
+    double f = 1, r = 0;
+    for (; i > 0; i /= base) {
+        f /= base;
+        r += f * (i % base);
+    }
+    return r;
+}
+
+static Vec3f clamp01(const Vec3f& c)
+{
+    return Vec3f(std::max(float(0), std::min(float(1), c.x)), std::max(float(0), std::min(float(1), c.y)),
+        std::max(float(0), std::min(float(1), c.z)));
+}
+
+void render(const RayScene& scene, RayFramebuffer& fb, ThreadPool& pool, const RayAntialiasing& aa)
+{
+    unsigned width = fb.width, height = fb.height;
 
     float invWidth = 1 / float(width), invHeight = 1 / float(height);
-    float fov = 30, aspectratio = width / float(height);
+    float fov = scene.camera.fov, aspectratio = width / float(height);
     float angle = tan(M_PI * 0.5 * fov / 180.);
-    // Trace rays
-    for (unsigned y = 0; y < height; ++y) {
-        for (unsigned x = 0; x < width; ++x, ++pixel) {
-            float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
-            float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
-            Vec3f raydir(xx, yy, -1);
-            raydir.normalize();
-            *pixel = trace(Vec3f(0), raydir, spheres, 0);
-            imageBuff[y][x][0] = pixel->x * 255.0;
-            imageBuff[y][x][1] = pixel->y * 255.0;
-            imageBuff[y][x][2] = pixel->z * 255.0;
-            imageBuff[y][x][3] = 255.0;
+    Vec3f eye = scene.camera.position, right, up, forward;
+    scene.camera.basis(right, up, forward);
+
+    unsigned tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // with antialiasing on, the centre rays go here first so the second pass can compare neighbours
+    std::vector<Vec3f> centres;
+    if (aa.maxSamples > 1)
+        centres.resize(width * height);
+
+    auto renderTile = [&](unsigned tile) {
+        unsigned long long rays = threadRayCount;
+        unsigned x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+        unsigned x1 = std::min(x0 + TILE_SIZE, width), y1 = std::min(y0 + TILE_SIZE, height);
+
+        // primary rays all start at the eye and go through neighbouring pixels, so they are traced
+        // as packets along each row of the tile, the bounces are traced one ray at a time
+        unsigned lanes = scene.kernels->packetWidth;
+        RayPacket packet;
+        Vec3f raydir[RAY_PACKET_MAX];
+
+        for (unsigned y = y0; y < y1; ++y) {
+            for (unsigned x = x0; x < x1; x += lanes) {
+                unsigned n = std::min(lanes, x1 - x);
+                for (unsigned k = 0; k < lanes; k++) {
+                    unsigned px = x + std::min(k, n - 1); // pad a short packet with copies of its last ray
+                    float xx = (2 * ((px + 0.5) * invWidth) - 1) * angle * aspectratio;
+                    float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
+                    raydir[k] = right * xx + up * yy + forward;
+                    raydir[k].normalize();
+                    packet.ox[k] = eye.x, packet.oy[k] = eye.y, packet.oz[k] = eye.z;
+                    packet.dx[k] = raydir[k].x, packet.dy[k] = raydir[k].y, packet.dz[k] = raydir[k].z;
+                    packet.tnear[k] = INFINITY;
+                }
+                closestHitPacket(scene, packet);
+
+                for (unsigned k = 0; k < n; k++) {
+                    Vec3f c = shade(eye, raydir[k], scene, packet.hit[k], packet.tnear[k]);
+                    if (centres.empty())
+                        fb.write(x + k, y, c);
+                    else
+                        centres[y * width + x + k] = c;
+                }
+            }
         }
-    }
-#ifdef WRITE_TO_PPM
-    // Save result to a PPM image (keep these flags if you compile under Windows)
-    std::ofstream ofs("./untitled.ppm", std::ios::out | std::ios::binary);
-    ofs << "P6\n" << width << " " << height << "\n255\n";
-    for (unsigned i = 0; i < width * height; ++i) {
-        ofs << (unsigned char)(std::min(float(1), image[i].x) * 255) <<
-            (unsigned char)(std::min(float(1), image[i].y) * 255) <<
-            (unsigned char)(std::min(float(1), image[i].z) * 255);
-    }
-    ofs.close();
-#endif
+        totalRayCount += threadRayCount - rays;
+    };
+
+    auto refineTile = [&](unsigned tile) {
+        unsigned long long rays = threadRayCount;
+        unsigned x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+        unsigned x1 = std::min(x0 + TILE_SIZE, width), y1 = std::min(y0 + TILE_SIZE, height);
+
+        // the biggest channel difference with any of the four neighbours, as it will be displayed
+        auto contrast = [&](unsigned x, unsigned y) {
+            Vec3f c = clamp01(centres[y * width + x]);
+            float most = 0;
+            auto compare = [&](unsigned nx, unsigned ny) {
+                Vec3f d = clamp01(centres[ny * width + nx]) - c;
+                most = std::max(most, std::max(std::fabs(d.x), std::max(std::fabs(d.y), std::fabs(d.z))));
+            };
+            if (x > 0) compare(x - 1, y);
+            if (x + 1 < width) compare(x + 1, y);
+            if (y > 0) compare(x, y - 1);
+            if (y + 1 < height) compare(x, y + 1);
+            return most;
+        };
+
+        for (unsigned y = y0; y < y1; ++y) {
+            for (unsigned x = x0; x < x1; ++x) {
+                Vec3f sum = centres[y * width + x];
+                unsigned n = 1;
+
+                if (contrast(x, y) > aa.contrast) {
+                    // the spread is measured on clamped colours, an HDR light would otherwise never settle
+                    Vec3f c = clamp01(sum), clampedSum = c, sum2 = c * c;
+
+                    while (n < aa.maxSamples) {
+                        for (unsigned end = std::min(n + AA_BATCH, aa.maxSamples); n < end; n++) {
+                            float xx = (2 * ((x + halton(n, 2)) * invWidth) - 1) * angle * aspectratio;
+                            float yy = (1 - 2 * ((y + halton(n, 3)) * invHeight)) * angle;
+                            Vec3f raydir = right * xx + up * yy + forward;
+                            raydir.normalize();
+                            Vec3f s = trace(eye, raydir, scene);
+                            sum += s;
+                            c = clamp01(s);
+                            clampedSum += c;
+                            sum2 += c * c;
+                        }
+                        // done once the standard error of the average is well under the contrast that triggered it
+                        Vec3f mean = clampedSum * (1 / float(n)), variance = sum2 * (1 / float(n)) - mean * mean;
+                        float error2 = std::max(variance.x, std::max(variance.y, variance.z)) / n;
+                        if (error2 < aa.contrast * aa.contrast * (1 / 16.f))
+                            break;
+                    }
+                }
+                fb.write(x, y, sum * (1 / float(n)));
+            }
+        }
+        totalRayCount += threadRayCount - rays;
+    };
+    // Trace rays
+    pool.parallelFor(tilesX * tilesY, renderTile);
+    if (!centres.empty())
+        pool.parallelFor(tilesX * tilesY, refineTile);
+}
 
-    delete[] image;
+void render(const RayScene& scene, RayFramebuffer& fb, unsigned threads, const RayAntialiasing& aa)
+{
+    if (threads == 0) {
+        render(scene, fb, ThreadPool::shared(), aa);
+        return;
+    }
+    ThreadPool pool(threads);
+    render(scene, fb, pool, aa);
 }
 
-int RayTracer()
+void demoScene(RayScene& scene)
 {
-    //srand48(13);
-    std::vector<Sphere> spheres;
+    std::vector<Sphere>& spheres = scene.spheres;
+    spheres.clear();
     // position, radius, surface color, reflectivity, transparency, emission color
     spheres.push_back(Sphere(Vec3f(0.0, -10004, -20), 10000, Vec3f(0.20, 0.20, 0.20), 0, 0.0));
     spheres.push_back(Sphere(Vec3f(0.0, 0, -20), 4, Vec3f(1.00, 0.32, 0.36), 1, 0.5));
@@ -229,7 +394,188 @@ int RayTracer()
     spheres.push_back(Sphere(Vec3f(-5.5, 0, -15), 3, Vec3f(0.90, 0.90, 0.90), 1, 0.0));
     // light
     spheres.push_back(Sphere(Vec3f(0.0, 20, -30), 3, Vec3f(0.00, 0.00, 0.00), 0, 0.0, Vec3f(3)));
-    render(spheres);
+    scene.build();
+}
+
+// the demo scene traced into a width x height RGBA8 image (the sandbox passes its imageBuff)
+int RayTracer(unsigned char* rgba, unsigned width, unsigned height, unsigned threads)
+{
+    //srand48(13);
+    RayScene scene;
+    demoScene(scene);
+
+    RayFramebuffer fb(rgba, width, height, RAY_PIXEL_RGBA8);
+    render(scene, fb, threads);
+
+#ifdef WRITE_TO_PPM
+    // Save result to a PPM image (keep these flags if you compile under Windows)
+    std::ofstream ofs("./untitled.ppm", std::ios::out | std::ios::binary);
+    ofs << "P6\n" << fb.width << " " << fb.height << "\n255\n";
+    for (unsigned i = 0; i < fb.width * fb.height; ++i)
+        ofs << rgba[i * 4] << rgba[i * 4 + 1] << rgba[i * 4 + 2];
+    ofs.close();
+#endif
 
     return 0;
 }
+
+ProgressiveRayTracer::ProgressiveRayTracer(unsigned width, unsigned height, unsigned samplesPerPass, unsigned maxPasses) :
+    width(width), height(height), samplesPerPass(samplesPerPass), maxPasses(maxPasses),
+    accum(width * height), latest(width * height)
+{
+}
+
+ProgressiveRayTracer::~ProgressiveRayTracer()
+{
+    stop();
+}
+
+void ProgressiveRayTracer::reset()
+{
+    std::fill(accum.begin(), accum.end(), Vec3f(0));
+    passCount = 0;
+}
+
+void ProgressiveRayTracer::start(const RayScene& scene, unsigned threads)
+{
+    stop();
+    reset();
+    quit = false;
+
+    // the window keeps one core to itself so it can hold its frame rate
+    // (hardware_concurrency() may say 0 when it can't tell, which is one thread here)
+    if (threads == 0)
+        threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+    worker = std::thread(&ProgressiveRayTracer::run, this, &scene, threads);
+}
+
+void ProgressiveRayTracer::stop()
+{
+    quit = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+unsigned ProgressiveRayTracer::resolve(RayFramebuffer& fb)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (unsigned y = 0; y < height; y++)
+        for (unsigned x = 0; x < width; x++)
+            fb.write(x, y, latest[y * width + x]);
+    return publishCount;
+}
+
+bool ProgressiveRayTracer::tracePass(const RayScene& scene, ThreadPool& pool)
+{
+    float invWidth = 1 / float(width), invHeight = 1 / float(height);
+    float fov = scene.camera.fov, aspectratio = width / float(height);
+    float angle = tan(M_PI * 0.5 * fov / 180.);
+    Vec3f eye = scene.camera.position, right, up, forward;
+    scene.camera.basis(right, up, forward);
+
+    unsigned tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned pass = passCount;
+
+    pool.parallelFor(tilesX * tilesY, [&](unsigned tile) {
+        if (quit)
+            return;
+        unsigned long long rays = threadRayCount;
+        unsigned x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+        unsigned x1 = std::min(x0 + TILE_SIZE, width), y1 = std::min(y0 + TILE_SIZE, height);
+
+        for (unsigned y = y0; y < y1; ++y) {
+            for (unsigned x = x0; x < x1; ++x) {
+                RayRandom rnd(y * width + x, pass);
+                Vec3f sum = 0;
+                // a random spot inside the pixel each sample, which also antialiases the edges
+                for (unsigned s = 0; s < samplesPerPass; s++) {
+                    float xx = (2 * ((x + rnd.next()) * invWidth) - 1) * angle * aspectratio;
+                    float yy = (1 - 2 * ((y + rnd.next()) * invHeight)) * angle;
+                    Vec3f raydir = right * xx + up * yy + forward;
+                    raydir.normalize();
+                    sum += tracePath(eye, raydir, scene, rnd);
+                }
+                accum[y * width + x] += sum;
+            }
+        }
+        totalRayCount += threadRayCount - rays;
+        });
+
+    if (quit)
+        return false;
+
+    float scale = 1.0f / float((pass + 1) * samplesPerPass);
+    std::lock_guard<std::mutex> guard(lock);
+    for (unsigned i = 0; i < width * height; i++)
+        latest[i] = accum[i] * scale;
+    passCount = pass + 1;
+    publishCount++;
+    return true;
+}
+
+void ProgressiveRayTracer::run(const RayScene* scene, unsigned threads)
+{
+    ThreadPool pool(threads);
+
+    while (!quit && passCount < maxPasses)
+        if (!tracePass(*scene, pool))
+            break;
+}
+
+// the sandbox's progressive ray traced texture, see setupTextures() and updateTextures()
+static RayScene* progressiveScene = NULL;
+static ProgressiveRayTracer* progressiveTracer = NULL;
+static unsigned progressiveThreads = 0;
+
+void stopProgressiveRayTracer();
+
+// traces scene (which it takes ownership of), or the demo spheres when it's NULL
+void startProgressiveRayTracer(unsigned width, unsigned height, unsigned threads, RayScene* scene)
+{
+    stopProgressiveRayTracer();
+
+    progressiveScene = scene;
+    if (progressiveScene == NULL) {
+        progressiveScene = new RayScene();
+        demoScene(*progressiveScene);
+    }
+
+    progressiveTracer = new ProgressiveRayTracer(width, height);
+    progressiveTracer->start(*progressiveScene, progressiveThreads = threads);
+}
+
+// swaps another scene into the progressive texture, the tracer takes ownership of it
+void showInProgressiveRayTracer(RayScene* scene)
+{
+    if (progressiveTracer == NULL) {
+        delete scene;
+        return;
+    }
+    progressiveTracer->stop();
+    delete progressiveScene;
+    progressiveScene = scene;
+    progressiveTracer->start(*progressiveScene, progressiveThreads);
+}
+
+unsigned progressiveRayTracerPasses()
+{
+    return progressiveTracer ? progressiveTracer->published() : 0;
+}
+
+unsigned resolveProgressiveRayTracer(unsigned char* rgba)
+{
+    if (progressiveTracer == NULL)
+        return 0;
+    RayFramebuffer fb(rgba, progressiveTracer->width, progressiveTracer->height, RAY_PIXEL_RGBA8);
+    return progressiveTracer->resolve(fb);
+}
+
+void stopProgressiveRayTracer()
+{
+    delete progressiveTracer;
+    delete progressiveScene;
+    progressiveTracer = NULL;
+    progressiveScene = NULL;
+}
@@ -0,0 +1,562 @@
+#pragma once
+
+// shared types for the CPU ray tracer (RayTracing.cpp)
+// this header has no GL dependencies, note that its Sphere is not the Sphere mesh in SphereModel.h
+
+#include <cmath> 
+#include <vector> 
+#include <iostream> 
+#include <algorithm> 
+#include <thread> 
+#include <atomic> 
+#include <mutex> 
+#include <new> 
+#include <cassert>
+
+#if defined __linux__ || defined __APPLE__ 
+// "Compiled for Linux
+#else 
+// Windows doesn't define these values by default, Linux does
+#define M_PI 3.141592653589793 
+#define INFINITY 1e8 
+#endif 
+
+template<typename T>
+class Vec3
+{
+public:
+    T x, y, z;
+    Vec3() : x(T(0)), y(T(0)), z(T(0)) {}
+    Vec3(T xx) : x(xx), y(xx), z(xx) {}
+    Vec3(T xx, T yy, T zz) : x(xx), y(yy), z(zz) {}
+    Vec3& normalize()
+    {
+        T nor2 = length2();
+        if (nor2 > 0) {
+            T invNor = 1 / sqrt(nor2);
+            x *= invNor, y *= invNor, z *= invNor;
+        }
+        return *this;
+    }
+    Vec3<T> operator * (const T& f) const { return Vec3<T>(x * f, y * f, z * f); }
+    Vec3<T> operator * (const Vec3<T>& v) const { return Vec3<T>(x * v.x, y * v.y, z * v.z); }
+    T dot(const Vec3<T>& v) const { return x * v.x + y * v.y + z * v.z; }
+    Vec3<T> operator - (const Vec3<T>& v) const { return Vec3<T>(x - v.x, y - v.y, z - v.z); }
+    Vec3<T> operator + (const Vec3<T>& v) const { return Vec3<T>(x + v.x, y + v.y, z + v.z); }
+    Vec3<T>& operator += (const Vec3<T>& v) { x += v.x, y += v.y, z += v.z; return *this; }
+    Vec3<T>& operator *= (const Vec3<T>& v) { x *= v.x, y *= v.y, z *= v.z; return *this; }
+    Vec3<T> operator - () const { return Vec3<T>(-x, -y, -z); }
+    T operator [] (int i) const { return (&x)[i]; }
+    Vec3<T> cross(const Vec3<T>& v) const { return Vec3<T>(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+    T length2() const { return x * x + y * y + z * z; }
+    T length() const { return sqrt(length2()); }
+    friend std::ostream& operator << (std::ostream& os, const Vec3<T>& v)
+    {
+        os << "[" << v.x << " " << v.y << " " << v.z << "]";
+        return os;
+    }
+};
+
+typedef Vec3<float> Vec3f;
+
+class Sphere
+{
+public:
+    Vec3f center;                           /// position of the sphere 
+    float radius, radius2;                  /// sphere radius and radius^2 
+    Vec3f surfaceColor, emissionColor;      /// surface color and emission (light) 
+    float transparency, reflection;         /// surface transparency and reflectivity 
+    Sphere(
+        const Vec3f& c,
+        const float& r,
+        const Vec3f& sc,
+        const float& refl = 0,
+        const float& transp = 0,
+        const Vec3f& ec = 0) :
+        center(c), radius(r), radius2(r* r), surfaceColor(sc), emissionColor(ec),
+        transparency(transp), reflection(refl)
+    { /* empty */
+    }
+
+    bool intersect(const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const
+    {
+        Vec3f l = center - rayorig;
+        float tca = l.dot(raydir);
+        if (tca < 0) return false;
+        float d2 = l.dot(l) - tca * tca;
+        if (d2 > radius2) return false;
+        float thc = sqrt(radius2 - d2);
+        t0 = tca - thc;
+        t1 = tca + thc;
+
+        return true;
+    }
+};
+
+// axis aligned bounding box
+struct AABB
+{
+    Vec3f bmin = Vec3f(INFINITY), bmax = Vec3f(-INFINITY);
+
+    void expand(const Vec3f& p)
+    {
+        bmin = Vec3f(std::min(bmin.x, p.x), std::min(bmin.y, p.y), std::min(bmin.z, p.z));
+        bmax = Vec3f(std::max(bmax.x, p.x), std::max(bmax.y, p.y), std::max(bmax.z, p.z));
+    }
+    void expand(const AABB& b) { expand(b.bmin); expand(b.bmax); }
+    Vec3f centroid() const { return (bmin + bmax) * 0.5f; }
+    float surfaceArea() const
+    {
+        Vec3f e = bmax - bmin;
+        if (e.x < 0) return 0;
+        return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+    // slab test, returns the entry distance through tEntry
+    bool intersect(const Vec3f& rayorig, const Vec3f& invdir, float tmax, float& tEntry) const
+    {
+        float tx0 = (bmin.x - rayorig.x) * invdir.x, tx1 = (bmax.x - rayorig.x) * invdir.x;
+        float ty0 = (bmin.y - rayorig.y) * invdir.y, ty1 = (bmax.y - rayorig.y) * invdir.y;
+        float tz0 = (bmin.z - rayorig.z) * invdir.z, tz1 = (bmax.z - rayorig.z) * invdir.z;
+
+        float tnear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float tfar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tmax));
+
+        tEntry = tnear;
+        return tnear <= tfar;
+    }
+};
+
+#define RAY_PACKET_MAX 8
+
+// a bundle of up to RAY_PACKET_MAX rays laid out for SIMD, hit holds the SphereSoA entry of the closest hit or -1
+// each array is one AVX register and starts on a 32 byte boundary, the kernels use aligned loads on them
+struct alignas(32) RayPacket
+{
+    float ox[RAY_PACKET_MAX], oy[RAY_PACKET_MAX], oz[RAY_PACKET_MAX];
+    float dx[RAY_PACKET_MAX], dy[RAY_PACKET_MAX], dz[RAY_PACKET_MAX];
+    float tnear[RAY_PACKET_MAX];
+    int hit[RAY_PACKET_MAX];
+};
+
+struct BVHNode
+{
+    AABB bounds;
+    unsigned start;     /// leaf: first entry in BVH::order, interior: index of the first child (the second one follows it)
+    unsigned count;     /// number of primitives in a leaf, 0 for interior nodes
+};
+
+// entries in a traversal stack, a node at depth d leaves at most d siblings on it plus itself, so build() turns
+// a range into a leaf rather than split it past depth BVH_STACK_SIZE - 1
+#define BVH_STACK_SIZE 64
+
+// bounding volume hierarchy built with the surface area heuristic
+// it only knows about primitive bounds, the caller supplies the actual intersection test
+class BVH
+{
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<unsigned> order;    /// primitive indices, leaves reference contiguous runs of this
+    unsigned depth = 0;             /// of the deepest leaf, the root is 0, always under BVH_STACK_SIZE
+
+    void build(const std::vector<AABB>& bounds);
+
+    // nearest hit : leaf(first, count, tnear) tests the primitives order[first] .. order[first + count - 1]
+    // and shrinks tnear when one of them is closer
+    template<typename LeafFn>
+    void nearest(const Vec3f& rayorig, const Vec3f& raydir, float& tnear, LeafFn leaf) const
+    {
+        if (nodes.empty()) return;
+
+        Vec3f invdir(1 / raydir.x, 1 / raydir.y, 1 / raydir.z);
+        unsigned stack[BVH_STACK_SIZE], top = 0;
+        float entry[BVH_STACK_SIZE];
+
+        if (!nodes[0].bounds.intersect(rayorig, invdir, tnear, entry[0])) return;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            --top;
+            if (entry[top] > tnear) // something closer turned up since this node was pushed
+                continue;
+
+            const BVHNode& node = nodes[stack[top]];
+
+            if (node.count > 0) {
+                leaf(node.start, node.count, tnear);
+                continue;
+            }
+            // visit the closer child first so tnear shrinks as early as possible
+            unsigned first = node.start, second = node.start + 1;
+            float t0, t1;
+            bool hit0 = nodes[first].bounds.intersect(rayorig, invdir, tnear, t0);
+            bool hit1 = nodes[second].bounds.intersect(rayorig, invdir, tnear, t1);
+
+            assert(top + 2 <= BVH_STACK_SIZE);
+            if (hit0 && hit1) {
+                if (t1 < t0) std::swap(first, second), std::swap(t0, t1);
+                entry[top] = t1, stack[top++] = second;
+                entry[top] = t0, stack[top++] = first;
+            }
+            else if (hit0)
+                entry[top] = t0, stack[top++] = first;
+            else if (hit1)
+                entry[top] = t1, stack[top++] = second;
+        }
+    }
+
+    // any hit : stops at the first leaf for which leaf(first, count) returns true
+    template<typename LeafFn>
+    bool any(const Vec3f& rayorig, const Vec3f& raydir, float tmax, LeafFn leaf) const
+    {
+        if (nodes.empty()) return false;
+
+        Vec3f invdir(1 / raydir.x, 1 / raydir.y, 1 / raydir.z);
+        unsigned stack[BVH_STACK_SIZE], top = 0;
+        float tEntry;
+
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const BVHNode& node = nodes[stack[--top]];
+
+            if (!node.bounds.intersect(rayorig, invdir, tmax, tEntry))
+                continue;
+
+            if (node.count > 0) {
+                if (leaf(node.start, node.count))
+                    return true;
+                continue;
+            }
+            assert(top + 2 <= BVH_STACK_SIZE);
+            stack[top++] = node.start + 1;
+            stack[top++] = node.start;
+        }
+        return false;
+    }
+
+    // nearest hit for a packet of rays sharing one traversal, a node is visited when any ray in the packet hits it
+    // leaf(first, count) updates the packet's own tnear/hit values
+    template<typename LeafFn>
+    void nearestPacket(const RayPacket& p, unsigned width, LeafFn leaf) const
+    {
+        if (nodes.empty()) return;
+
+        Vec3f orig[RAY_PACKET_MAX], invdir[RAY_PACKET_MAX];
+        for (unsigned k = 0; k < width; k++) {
+            orig[k] = Vec3f(p.ox[k], p.oy[k], p.oz[k]);
+            invdir[k] = Vec3f(1 / p.dx[k], 1 / p.dy[k], 1 / p.dz[k]);
+        }
+        unsigned stack[BVH_STACK_SIZE], top = 0;
+        float tEntry;
+
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const BVHNode& node = nodes[stack[--top]];
+
+            bool visit = false;
+            for (unsigned k = 0; k < width && !visit; k++)
+                visit = node.bounds.intersect(orig[k], invdir[k], p.tnear[k], tEntry);
+            if (!visit)
+                continue;
+
+            if (node.count > 0) {
+                leaf(node.start, node.count);
+                continue;
+            }
+            assert(top + 2 <= BVH_STACK_SIZE);
+            stack[top++] = node.start + 1;
+            stack[top++] = node.start;
+        }
+    }
+};
+
+// std::vector storage starting on a 32 byte boundary, for arrays the SIMD kernels read with aligned loads
+template<typename T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    static const std::size_t alignment = 32;
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+    template<typename U> struct rebind { typedef AlignedAllocator<U> other; };
+
+    T* allocate(std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* p, std::size_t) { ::operator delete(p, std::align_val_t(alignment)); }
+
+    template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// structure of arrays copy of the sphere geometry, stored in BVH order so every leaf is one contiguous run
+// the arrays start on a 32 byte boundary and are padded past the end to a whole AVX register, so a kernel can
+// round a leaf's first entry down to its register width and always load full aligned registers
+struct SphereSoA
+{
+    std::vector<float, AlignedAllocator<float>> cx, cy, cz, radius2;
+    std::vector<unsigned> index;    /// entry -> index into RayScene::spheres
+
+    void build(const std::vector<Sphere>& spheres, const std::vector<unsigned>& order);
+};
+
+// ray / sphere intersection kernels (RaySIMD.cpp), picked at runtime from what the CPU supports
+struct SphereKernels
+{
+    const char* name;
+    unsigned packetWidth;
+
+    // one ray against spheres [first, first + count), returns the closest entry below tnear (or -1) and updates tnear
+    // the sphere with scene index skip is ignored, pass ~0u to test them all
+    int (*nearest)(const SphereSoA& soa, unsigned first, unsigned count, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, unsigned skip);
+    // packetWidth rays against one sphere entry
+    void (*packet)(const SphereSoA& soa, unsigned sphere, RayPacket& p);
+
+    static const SphereKernels& best();
+    static std::vector<const SphereKernels*> available();
+};
+
+// surface properties shared by every triangle of a mesh, same meaning as the Sphere fields
+struct RayMesh
+{
+    Vec3f surfaceColor = Vec3f(0.8f), emissionColor = Vec3f(0);
+    float transparency = 0, reflection = 0;
+};
+
+// one triangle of a mesh, n0..n2 are the vertex normals (all zero when the model had none)
+struct RayTriangle
+{
+    Vec3f v0, v1, v2;
+    Vec3f n0, n1, n2;
+    unsigned mesh;      /// index into RayScene::meshes
+};
+
+// per ray setup for the watertight ray / triangle test of Woop, Benthin and Wald (JCGT 2013)
+// the ray is sheared so it runs down the z axis, after which the edge tests of neighbouring
+// triangles use exactly the same arithmetic and a ray can't slip through a shared edge
+struct WatertightRay
+{
+    Vec3f orig;
+    int kx, ky, kz;
+    float Sx, Sy, Sz;
+
+    WatertightRay(const Vec3f& rayorig, const Vec3f& raydir) : orig(rayorig)
+    {
+        kz = std::fabs(raydir.x) > std::fabs(raydir.y) ? (std::fabs(raydir.x) > std::fabs(raydir.z) ? 0 : 2) : (std::fabs(raydir.y) > std::fabs(raydir.z) ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (raydir[kz] < 0) std::swap(kx, ky); // keep the winding the same
+        Sx = raydir[kx] / raydir[kz];
+        Sy = raydir[ky] / raydir[kz];
+        Sz = 1 / raydir[kz];
+    }
+
+    // distance along the ray to the triangle if it is hit in (0, tmax)
+    bool intersect(const RayTriangle& tri, float tmax, float& t) const
+    {
+        Vec3f A = tri.v0 - orig, B = tri.v1 - orig, C = tri.v2 - orig;
+
+        float Ax = A[kx] - Sx * A[kz], Ay = A[ky] - Sy * A[kz];
+        float Bx = B[kx] - Sx * B[kz], By = B[ky] - Sy * B[kz];
+        float Cx = C[kx] - Sx * C[kz], Cy = C[ky] - Sy * C[kz];
+
+        float U = Cx * By - Cy * Bx;
+        float V = Ax * Cy - Ay * Cx;
+        float W = Bx * Ay - By * Ax;
+
+        // exactly on an edge, redo the edge tests in double so the answer is consistent
+        if (U == 0 || V == 0 || W == 0) {
+            U = (float)((double)Cx * By - (double)Cy * Bx);
+            V = (float)((double)Ax * Cy - (double)Ay * Cx);
+            W = (float)((double)Bx * Ay - (double)By * Ax);
+        }
+        if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))
+            return false;
+
+        float det = U + V + W;
+        if (det == 0)
+            return false;
+
+        float T = U * (Sz * A[kz]) + V * (Sz * B[kz]) + W * (Sz * C[kz]);
+        t = T / det;
+        return t > 0 && t < tmax;
+    }
+};
+
+// a pinhole camera, the defaults are the view the ray tracer always had
+struct RayCamera
+{
+    Vec3f position = Vec3f(0), target = Vec3f(0, 0, -1), up = Vec3f(0, 1, 0);
+    float fov = 30;     /// vertical field of view in degrees
+
+    // unit vectors for the image plane, a primary ray goes along right * xx + up * yy + forward
+    void basis(Vec3f& right, Vec3f& camUp, Vec3f& forward) const
+    {
+        forward = target - position;
+        forward.normalize();
+        right = forward.cross(up);
+        right.normalize();
+        camUp = right.cross(forward);
+    }
+};
+
+// what shading needs to know about the point a ray hit
+struct RaySurface
+{
+    Vec3f normal;       /// unit normal, not yet turned to face the ray
+    Vec3f surfaceColor, emissionColor;
+    float transparency, reflection;
+};
+
+// everything trace() needs to know about the world
+// a hit is identified by one index, spheres come first and triangle i is spheres.size() + i
+struct RayScene
+{
+    std::vector<Sphere> spheres;
+    std::vector<unsigned> lights;   /// indices of the emissive spheres
+    BVH bvh;
+    SphereSoA soa;
+    const SphereKernels* kernels = &SphereKernels::best();
+
+    std::vector<RayMesh> meshes;
+    std::vector<RayTriangle> triangles;     /// reordered by build() to follow triangleBVH
+    BVH triangleBVH;
+
+    RayCamera camera;
+
+    // adds vertexCount / 3 triangles from packed xyz arrays (one corner after another, as ModelImporter
+    // returns them), normals may be NULL, modelMatrix is an optional column major 4x4 (glm layout)
+    unsigned addMesh(const float* positions, const float* normals, unsigned vertexCount, const RayMesh& material, const float* modelMatrix = NULL);
+    // the same from an indexed mesh, indexCount / 3 triangles whose corners index vertices of stride floats
+    // (position, and normal if normals isn't NULL, at the start of each), indexSize is 2 or 4 bytes
+    unsigned addIndexedMesh(const float* positions, const float* normals, unsigned stride, const void* indices, unsigned indexSize,
+        unsigned indexCount, const RayMesh& material, const float* modelMatrix = NULL);
+
+    // call after changing the sphere or triangle lists
+    void build();
+
+    RaySurface surface(int hit, const Vec3f& phit) const;
+};
+
+// pixel layouts a RayFramebuffer can hold
+enum RayPixelFormat {
+    RAY_PIXEL_RGBA8,    /// 4 bytes per pixel, colours clamped to [0, 1], alpha 255
+    RAY_PIXEL_RGB32F    /// 3 floats per pixel, unclamped
+};
+
+// a caller owned image for the ray tracer to write into, row 0 is the top of the picture
+struct RayFramebuffer
+{
+    void* pixels;
+    unsigned width, height;
+    size_t stride;      /// bytes from the start of one row to the next
+    RayPixelFormat format;
+
+    // stride 0 means the rows are packed back to back
+    RayFramebuffer(void* pixels, unsigned width, unsigned height, RayPixelFormat format = RAY_PIXEL_RGBA8, size_t stride = 0) :
+        pixels(pixels), width(width), height(height), stride(stride ? stride : width * pixelSize(format)), format(format)
+    {
+    }
+
+    static size_t pixelSize(RayPixelFormat format) { return format == RAY_PIXEL_RGBA8 ? 4 : 3 * sizeof(float); }
+
+    void write(unsigned x, unsigned y, const Vec3f& c)
+    {
+        unsigned char* row = (unsigned char*)pixels + y * stride;
+        if (format == RAY_PIXEL_RGBA8) {
+            unsigned char* p = row + x * 4;
+            p[0] = (unsigned char)(std::max(float(0), std::min(float(1), c.x)) * 255);
+            p[1] = (unsigned char)(std::max(float(0), std::min(float(1), c.y)) * 255);
+            p[2] = (unsigned char)(std::max(float(0), std::min(float(1), c.z)) * 255);
+            p[3] = 255;
+        }
+        else {
+            float* p = (float*)row + x * 3;
+            p[0] = c.x, p[1] = c.y, p[2] = c.z;
+        }
+    }
+};
+
+// adaptive antialiasing for render()
+// after one ray through every pixel centre, pixels that differ from a neighbour by more than contrast
+// (in any channel, clamped to [0, 1]) are given more rays, a few at a time, until their average settles
+// or they have had maxSamples, so only the edges pay for it
+struct RayAntialiasing
+{
+    unsigned maxSamples = 1;    /// rays per pixel at most, 1 turns it off
+    float contrast = 0.1f;
+};
+
+// traces scene into fb (Whitted style, one ray per pixel unless aa says otherwise), the aspect ratio follows the framebuffer
+// threads == 0 uses every core, threads == 1 stays on the calling thread
+// nothing here is global, so several renders may run at once
+void render(const RayScene& scene, RayFramebuffer& fb, unsigned threads = 0, const RayAntialiasing& aa = RayAntialiasing());
+// the same on a pool the caller already has, like ProgressiveRayTracer::tracePass()
+class ThreadPool;
+void render(const RayScene& scene, RayFramebuffer& fb, ThreadPool& pool, const RayAntialiasing& aa = RayAntialiasing());
+
+// the spheres the sandbox has always shown (RayTracing.cpp)
+void demoScene(RayScene& scene);
+// loads an OBJ through ModelImporter into scene as one mesh (RayMeshImport.cpp)
+bool addOBJToRayScene(RayScene& scene, const char* filePath, const RayMesh& material, const float* modelMatrix = NULL);
+
+// rays cast by the calling thread so far (closest hit and shadow queries)
+extern thread_local unsigned long long threadRayCount;
+// rays cast by every render() tile and progressive pass that has finished
+unsigned long long rayTracerRayCount();
+
+// closest sphere or triangle along a ray (see RayScene for the numbering, -1 for a miss) and its distance in tnear
+int closestHit(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float& tnear);
+// any hit shadow query, true when a sphere (other than sphere skip) or a triangle lies along the ray closer than tmax
+bool occluded(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float tmax, unsigned skip = ~0u);
+// same for a packet of kernels->packetWidth rays, results land in p.tnear / p.hit (numbered like closestHit)
+void closestHitPacket(const RayScene& scene, RayPacket& p);
+
+// triangle part of closestHit (RayMesh.cpp), shrinks tnear and sets hit when a triangle is closer
+void closestTriangle(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float& tnear, int& hit);
+// true when a triangle lies along the ray closer than tmax
+bool anyTriangle(const RayScene& scene, const Vec3f& rayorig, const Vec3f& raydir, float tmax);
+
+// times the scalar and SIMD kernels on primary rays of the scene and prints rays/sec for each (rtcli -bench)
+void benchmarkSphereKernels(const RayScene& scene, unsigned width, unsigned height);
+
+
+// traces the scene over and over on a background thread with a few random samples per pixel
+// each pass (Monte Carlo path tracing), the running average is kept in a float buffer and
+// handed out as an RGBA8 image whenever a pass completes
+class ProgressiveRayTracer
+{
+public:
+    ProgressiveRayTracer(unsigned width, unsigned height, unsigned samplesPerPass = 1, unsigned maxPasses = 1024);
+    ~ProgressiveRayTracer();
+
+    unsigned width, height;
+
+    // starts tracing scene (which must outlive the tracer or the next stop()), threads == 0 leaves one core for the caller
+    void start(const RayScene& scene, unsigned threads = 0);
+    void stop();
+
+    // clears the image and traces one pass at a time on the caller's thread (and pool) instead
+    void reset();
+    // returns false if stop() interrupted it
+    bool tracePass(const RayScene& scene, ThreadPool& pool);
+
+    // number of passes averaged so far
+    unsigned passes() const { return passCount; }
+    // number of images finished since the tracer was made, keeps counting across start() calls
+    unsigned published() const { return publishCount; }
+    // copies the latest average into fb (which must be width x height), returns published() for that image
+    unsigned resolve(RayFramebuffer& fb);
+
+private:
+    unsigned samplesPerPass, maxPasses;
+    std::vector<Vec3f> accum;
+    std::vector<Vec3f> latest;          /// average of the first passCount passes, guarded by lock
+    std::mutex lock;
+    std::atomic<unsigned> passCount{ 0 };
+    std::atomic<unsigned> publishCount{ 0 };
+    std::atomic<bool> quit{ false };
+    std::thread worker;
+
+    void run(const RayScene* scene, unsigned threads);
+};
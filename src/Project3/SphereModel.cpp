@@ -16,6 +16,7 @@
 #include "renderer.h"
 
 #include "SphereModel.h"
+#include "MeshOptimizer.h"
 
 SphereModel::SphereModel(Material* material, glm::mat4 m)
 {
@@ -33,7 +34,9 @@ SphereModel::SphereModel(Material* material, glm::mat4 m)
     glGenBuffers(numVBOs = 2, VBO);
     glGenBuffers(1, &EBO);
 
-    int numIndices = mySphere.getIndices().size();
+    const std::vector<float>& verts = mySphere.getVerts();
+    const std::vector<unsigned int>& indices = mySphere.getIndices();
+    int numIndices = indices.size();
     //
     // Notice!!!  Since this is a unit sphere, 
     // we can use the vertex coordinates as the vertex normals !!!
@@ -41,22 +44,12 @@ SphereModel::SphereModel(Material* material, glm::mat4 m)
     indexCount = numIndices;
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, mySphere.getVerts().size() * 4, mySphere.getVerts().data(), GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mySphere.getIndices().size() * 4, mySphere.getIndices().data(), GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // normal vector attribute  :  REUSE THE VERTEX COORDINATES !!!
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
+    // position, normal (REUSE THE VERTEX COORDINATES !!!) and texture coord attributes
+    uploadVertices(verts.data(), 5, (unsigned int)(verts.size() / 5), 0, 3);
 
-    // texture coord attribute
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(3);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * 4, indices.data(), GL_STATIC_DRAW);
 
     setupColorAttrib();
 
@@ -79,6 +72,10 @@ void Sphere::init(int prec) {
     numVertices = (prec + 1) * (prec + 1);
     numIndices = prec * prec * 6;
 
+    // 5 floats per vertex, position then texture coordinate
+    verts.reserve(numVertices * 5);
+    indices.reserve(numIndices);
+
     // calculate triangle vertices
     for (int i = 0; i <= prec; i++) {
         float y = (float)cos(toRadians(180.0f - i * 180.0f / prec));
@@ -113,10 +110,13 @@ void Sphere::init(int prec) {
             }
         }
     }
+
+    // rows of triangles miss the vertex cache a lot more than they need to
+    optimizeMesh("sphere", verts.data(), 5, numVertices, indices.data(), indices.size(), std::vector<size_t>(), true, true);
 }
 
 int Sphere::getNumVertices() { return numVertices; }
 int Sphere::getNumIndices() { return numIndices; }
-std::vector<int> Sphere::getIndices() { return indices; }
-std::vector<float> Sphere::getVerts() { return verts; }
+const std::vector<unsigned int>& Sphere::getIndices() const { return indices; }
+const std::vector<float>& Sphere::getVerts() const { return verts; }
 
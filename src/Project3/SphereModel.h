@@ -14,7 +14,7 @@ class Sphere
 private:
     int numVertices;
     int numIndices;
-    std::vector<int> indices;
+    std::vector<unsigned int> indices;
     std::vector<float> verts;
     void init(int);
     float toRadians(float degrees);
@@ -24,6 +24,6 @@ public:
     Sphere(int prec);
     int getNumVertices();
     int getNumIndices();
-    std::vector<int> getIndices();
-    std::vector<float> getVerts();
+    const std::vector<unsigned int>& getIndices() const;
+    const std::vector<float>& getVerts() const;
 };
\ No newline at end of file
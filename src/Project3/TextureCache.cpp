@@ -0,0 +1,459 @@
+//
+// BC1 / BC3 / BC5 encoding and .g4gtex texture caches, see TextureCache.h for the layout
+// nothing in here touches GL, loadTextures() does the upload
+//
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+using namespace glm;
+
+static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// the size and modification time of the image, what a cache has to match to be used
+static bool sourceStamp(const char* imagePath, std::string& stamp)
+{
+    std::error_code error;
+    auto bytes = std::filesystem::file_size(imagePath, error);
+    if (error)
+        return false;
+    auto written = std::filesystem::last_write_time(imagePath, error);
+    if (error)
+        return false;
+
+    stamp = std::to_string(TEXTURE_CACHE_VERSION) + " " + std::to_string((long long)bytes) + " " +
+        std::to_string((long long)written.time_since_epoch().count());
+    return true;
+}
+
+static unsigned blockBytes(unsigned format) { return format == TEXTURE_FORMAT_BC1 ? 8 : 16; }
+
+size_t compressedLevelBytes(unsigned format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// ---------------------------------------------------------------
+// the encoders, one 4x4 block at a time
+
+static unsigned short pack565(vec3 c)
+{
+    unsigned r = (unsigned)clamp((int)roundf(c.r * 31.0f / 255.0f), 0, 31);
+    unsigned g = (unsigned)clamp((int)roundf(c.g * 63.0f / 255.0f), 0, 63);
+    unsigned b = (unsigned)clamp((int)roundf(c.b * 31.0f / 255.0f), 0, 31);
+    return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+static vec3 unpack565(unsigned short c)
+{
+    unsigned r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+    return vec3((float)(r << 3 | r >> 2), (float)(g << 2 | g >> 4), (float)(b << 3 | b >> 2));
+}
+
+// picks the nearest of the four colours between c0 and c1 for every pixel, returns the squared error
+static float colorIndices(const vec3 pixels[16], unsigned short c0, unsigned short c1, unsigned& indices)
+{
+    vec3 a = unpack565(c0), b = unpack565(c1);
+    vec3 palette[4] = { a, b, (2.0f * a + b) / 3.0f, (a + 2.0f * b) / 3.0f };
+
+    float error = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float bestDistance = 1e30f;
+        for (int k = 0; k < 4; k++) {
+            vec3 d = pixels[i] - palette[k];
+            float distance = dot(d, d);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        indices |= (unsigned)best << (2 * i);
+        error += bestDistance;
+    }
+    return error;
+}
+
+// BC1 : the ends go on the line through the colours (their principal axis), then get one least squares fit
+// to the indices that picked, always the four colour mode (c0 > c1) so it is also the colour half of BC3
+static void encodeColorBlock(const vec3 pixels[16], unsigned char* out)
+{
+    vec3 mean(0.0f);
+    for (int i = 0; i < 16; i++)
+        mean += pixels[i];
+    mean /= 16.0f;
+
+    float cov[6] = { 0 };   // xx xy xz yy yz zz
+    for (int i = 0; i < 16; i++) {
+        vec3 d = pixels[i] - mean;
+        cov[0] += d.x * d.x; cov[1] += d.x * d.y; cov[2] += d.x * d.z;
+        cov[3] += d.y * d.y; cov[4] += d.y * d.z; cov[5] += d.z * d.z;
+    }
+    // a few rounds of power iteration find the axis near enough
+    vec3 axis(1.0f, 1.0f, 1.0f);
+    for (int k = 0; k < 8; k++) {
+        vec3 next(cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+            cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+            cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z);
+        float size = std::max(fabsf(next.x), std::max(fabsf(next.y), fabsf(next.z)));
+        if (size == 0.0f)
+            break;
+        axis = next / size;
+    }
+
+    float low = 1e30f, high = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = dot(pixels[i] - mean, axis);
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    float axisLength = dot(axis, axis);
+    if (axisLength > 0.0f) {
+        low /= axisLength;
+        high /= axisLength;
+    }
+    // pulled in a little, the ends are rarely worth a palette entry each
+    float inset = (high - low) / 16.0f;
+    unsigned short c0 = pack565(mean + axis * (high - inset)), c1 = pack565(mean + axis * (low + inset));
+
+    unsigned indices = 0;
+    float error = 0.0f;
+    if (c0 != c1) {
+        if (c0 < c1)
+            std::swap(c0, c1);
+        error = colorIndices(pixels, c0, c1, indices);
+
+        // the ends that fit those indices best
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        vec3 ax(0.0f), bx(0.0f);
+        for (int i = 0; i < 16; i++) {
+            float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            ax += a * pixels[i]; bx += b * pixels[i];
+        }
+        float determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) > 1e-6f) {
+            unsigned short f0 = pack565((ax * bb - bx * ab) / determinant), f1 = pack565((bx * aa - ax * ab) / determinant);
+            if (f0 < f1)
+                std::swap(f0, f1);
+            unsigned fitted;
+            if (f0 != f1) {
+                float fittedError = colorIndices(pixels, f0, f1, fitted);
+                if (fittedError < error) {
+                    c0 = f0;
+                    c1 = f1;
+                    indices = fitted;
+                }
+            }
+        }
+    }
+    // one colour all over is c0 with every index 0, whichever mode the decoder thinks it's in
+
+    out[0] = (unsigned char)c0; out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)c1; out[3] = (unsigned char)(c1 >> 8);
+    for (int k = 0; k < 4; k++)
+        out[4 + k] = (unsigned char)(indices >> (8 * k));
+}
+
+// BC4 (one channel, the alpha half of BC3 and each half of BC5) : the lowest and highest values as the ends
+// and the eight values between them (a0 > a1), the nearest one for every pixel
+static void encodeValueBlock(const unsigned char values[16], unsigned char* out)
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = std::min(low, (int)values[i]);
+        high = std::max(high, (int)values[i]);
+    }
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+
+    unsigned long long indices = 0;
+    if (high > low) {
+        // palette entry 0 is high, 1 is low, 2 to 7 step from high down to low
+        static const int order[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+        int range = high - low;
+        for (int i = 0; i < 16; i++) {
+            int step = ((high - values[i]) * 14 + range) / (2 * range);     // 0 (high) .. 7 (low), rounded
+            indices |= (unsigned long long)order[step] << (3 * i);
+        }
+    }
+    for (int k = 0; k < 6; k++)
+        out[2 + k] = (unsigned char)(indices >> (8 * k));
+}
+
+// the 4x4 pixels of a block, the last row and column are repeated past the edge of the image
+static void readBlock(const unsigned char* pixels, int width, int height, int channels, int bx, int by,
+    vec3 colors[16], unsigned char alphas[16])
+{
+    for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++) {
+            const unsigned char* p = pixels + ((size_t)std::min(by * 4 + y, height - 1) * width + std::min(bx * 4 + x, width - 1)) * channels;
+            int i = y * 4 + x;
+            if (channels >= 3)
+                colors[i] = vec3(p[0], p[1], p[2]);
+            else
+                colors[i] = vec3(p[0]);
+            alphas[i] = channels == 4 ? p[3] : channels == 2 ? p[1] : 255;
+        }
+}
+
+bool compressImage(const DecodedImage& image, CompressedImage& out)
+{
+    freeCompressed(out);
+    if (image.pixels == NULL)
+        return false;
+
+    out.format = TEXTURE_FORMAT_BC1;
+    if (image.channels == 2)
+        out.format = TEXTURE_FORMAT_BC5;
+    else if (image.channels == 4) {
+        // any alpha at all and it gets a block of its own, the mipmaps only average it so level 0 says it all
+        size_t count = (size_t)image.width * image.height;
+        for (size_t i = 0; i < count && out.format == TEXTURE_FORMAT_BC1; i++)
+            if (image.pixels[i * 4 + 3] != 255)
+                out.format = TEXTURE_FORMAT_BC3;
+    }
+    out.width = image.width;
+    out.height = image.height;
+
+    // where every level's blocks go, and which row of blocks each task starts
+    struct Row {
+        unsigned level;
+        int by;
+    };
+    std::vector<Row> rows;
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    int width = image.width, height = image.height;
+    for (unsigned level = 0; level <= image.mipmaps.size(); level++) {
+        offsets.push_back(total);
+        out.levelBytes.push_back(compressedLevelBytes(out.format, width, height));
+        total += out.levelBytes.back();
+        for (int by = 0; by < (height + 3) / 4; by++)
+            rows.push_back({ level, by });
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    out.blocks.resize(total);
+
+    unsigned format = out.format, bytes = blockBytes(out.format);
+    ThreadPool::shared().parallelFor((unsigned)rows.size(), [&](unsigned r) {
+        unsigned level = rows[r].level;
+        int levelWidth = std::max(1, image.width >> level), levelHeight = std::max(1, image.height >> level);
+        const unsigned char* pixels = level == 0 ? image.pixels : image.mipmaps[level - 1].data();
+        int blocksAcross = (levelWidth + 3) / 4;
+        unsigned char* block = &out.blocks[offsets[level] + (size_t)rows[r].by * blocksAcross * bytes];
+
+        vec3 colors[16];
+        unsigned char alphas[16], greys[16];
+        for (int bx = 0; bx < blocksAcross; bx++, block += bytes) {
+            readBlock(pixels, levelWidth, levelHeight, image.channels, bx, rows[r].by, colors, alphas);
+            if (format == TEXTURE_FORMAT_BC5) {
+                for (int i = 0; i < 16; i++)
+                    greys[i] = (unsigned char)colors[i].r;
+                encodeValueBlock(greys, block);
+                encodeValueBlock(alphas, block + 8);
+            }
+            else if (format == TEXTURE_FORMAT_BC3) {
+                encodeValueBlock(alphas, block);
+                encodeColorBlock(colors, block + 8);
+            }
+            else
+                encodeColorBlock(colors, block);
+        }
+    });
+
+    for (unsigned level = 0; level < offsets.size(); level++)
+        out.levels.push_back(&out.blocks[offsets[level]]);
+    return true;
+}
+
+void freeCompressed(CompressedImage& image)
+{
+    image.format = 0;
+    image.width = image.height = 0;
+    image.levels.clear();
+    image.levelBytes.clear();
+    image.blocks.clear();
+    image.blocks.shrink_to_fit();
+    image.file.reset();
+}
+
+// ---------------------------------------------------------------
+// the cache files
+
+bool TextureCache::load(const char* imagePath, CompressedImage& image)
+{
+    std::string stamp;
+    if (!sourceStamp(imagePath, stamp))
+        return false;
+
+    std::string cachePath = pathFor(imagePath);
+    std::unique_ptr<MappedFile> mapped = std::make_unique<MappedFile>(cachePath.c_str());
+    if (!mapped->good())
+        return false;
+
+    const char* p = mapped->data();
+    const char* end = p + mapped->size();
+
+    TextureCacheHeader header;
+    if (mapped->size() < sizeof(KTX_IDENTIFIER) + sizeof(header) || memcmp(p, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0) {
+        std::cout << cachePath << " isn't a KTX file, ignoring it\n";
+        return false;
+    }
+    p += sizeof(KTX_IDENTIFIER);
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    unsigned format = header.glInternalFormat;
+    if (header.endianness != 0x04030201u || (format != TEXTURE_FORMAT_BC1 && format != TEXTURE_FORMAT_BC3 && format != TEXTURE_FORMAT_BC5) ||
+        header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 || header.numberOfFaces != 1 ||
+        header.numberOfArrayElements != 0 || (size_t)(end - p) < header.bytesOfKeyValueData) {
+        std::cout << cachePath << " is from another version, ignoring it\n";
+        return false;
+    }
+
+    // every level down to 1x1, or the texture wouldn't be complete
+    unsigned levelCount = 1;
+    for (unsigned size = std::max(header.pixelWidth, header.pixelHeight); size > 1; size /= 2)
+        levelCount++;
+    if (header.numberOfMipmapLevels != levelCount) {
+        std::cout << cachePath << " is missing mipmaps, ignoring it\n";
+        return false;
+    }
+
+    std::string source;
+    const char* keys = p;
+    const char* keysEnd = p + header.bytesOfKeyValueData;
+    while (keysEnd - keys >= 4) {
+        unsigned length;
+        memcpy(&length, keys, sizeof(length));
+        keys += 4;
+        if ((size_t)(keysEnd - keys) < length)
+            break;
+        std::string key(keys, strnlen(keys, length));
+        if (key == "g4g.source" && key.size() + 1 < length)
+            source.assign(keys + key.size() + 1, strnlen(keys + key.size() + 1, length - key.size() - 1));
+        keys += (length + 3) & ~3u;
+    }
+    p = keysEnd;
+    if (source != stamp) {
+        std::cout << cachePath << " is older than " << imagePath << ", ignoring it\n";
+        return false;
+    }
+
+    std::vector<const unsigned char*> levels;
+    std::vector<size_t> levelBytes;
+    int width = (int)header.pixelWidth, height = (int)header.pixelHeight;
+    for (unsigned level = 0; level < levelCount; level++) {
+        unsigned size;
+        if (end - p < 4) {
+            std::cout << cachePath << " is cut short, ignoring it\n";
+            return false;
+        }
+        memcpy(&size, p, sizeof(size));
+        p += 4;
+        if (size != compressedLevelBytes(format, width, height) || (size_t)(end - p) < size) {
+            std::cout << cachePath << " is cut short, ignoring it\n";
+            return false;
+        }
+        levels.push_back((const unsigned char*)p);
+        levelBytes.push_back(size);
+        p += (size + 3) & ~3u;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    freeCompressed(image);
+    image.format = format;
+    image.width = (int)header.pixelWidth;
+    image.height = (int)header.pixelHeight;
+    image.levels.swap(levels);
+    image.levelBytes.swap(levelBytes);
+    image.file = std::move(mapped);
+    return true;
+}
+
+bool TextureCache::write(const char* imagePath, const CompressedImage& image)
+{
+    if (image.format == 0 || image.levels.empty())
+        return false;
+
+    std::string stamp;
+    if (!sourceStamp(imagePath, stamp))
+        return false;
+
+    // the key / value pairs, each padded to 4 bytes
+    std::string keys;
+    auto addKey = [&](const std::string& key, const std::string& value) {
+        std::string pair = key + '\0' + value + '\0';
+        unsigned length = (unsigned)pair.size();
+        keys.append((const char*)&length, sizeof(length));
+        keys += pair;
+        keys.append((4 - pair.size() % 4) % 4, '\0');
+    };
+    addKey("KTXorientation", "S=r,T=u");
+    addKey("g4g.source", stamp);
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.endianness = 0x04030201u;
+    header.glTypeSize = 1;
+    header.glInternalFormat = image.format;
+    // GL_RGB, GL_RGBA, GL_RG
+    header.glBaseInternalFormat = image.format == TEXTURE_FORMAT_BC1 ? 0x1907u : image.format == TEXTURE_FORMAT_BC3 ? 0x1908u : 0x8227u;
+    header.pixelWidth = (unsigned)image.width;
+    header.pixelHeight = (unsigned)image.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (unsigned)image.levels.size();
+    header.bytesOfKeyValueData = (unsigned)keys.size();
+
+    // written to the side and renamed into place, so a crash half way never leaves a cache that looks whole
+    std::string cachePath = pathFor(imagePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.good())
+            return false;
+
+        out.write((const char*)KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+        out.write((const char*)&header, sizeof(header));
+        out.write(keys.data(), keys.size());
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            // blocks are 8 or 16 bytes, never any padding
+            unsigned size = (unsigned)image.levelBytes[level];
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)image.levels[level], size);
+        }
+
+        if (!out.good()) {
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
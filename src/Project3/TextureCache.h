@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "textures.h"
+#include "MappedFile.h"
+
+// block compressed copy of an image file, kept next to it as <file>.g4gtex so the next launch skips the decode
+// nothing in here touches GL, loadTextures() and uploadImageSlice() do the upload
+//
+// images are cut into 4x4 blocks and every block is stored as two end colours and a 2 bit index per pixel
+// into the four colours between them (BC1, 8 bytes a block, what DXT1 was), alpha gets a block of its own
+// with two ends and 3 bit indices (BC3 = that and a BC1 block, 16 bytes), and BC5 is two of those alpha
+// blocks for two channels, so RGB is 8:1 at 4 bits a pixel and RGBA 4:1 at 8
+//   3 channels                     BC1
+//   4 channels                     BC3, or BC1 when every pixel is opaque
+//   1 channel                      BC1, grey
+//   2 channels (grey and alpha)    BC5, red is the grey and green the alpha (sample with a R R R G swizzle)
+//
+// the file is a KTX 1.1 file, so the usual tools open it
+//   identifier      12 bytes, KTX_IDENTIFIER
+//   header          TextureCacheHeader below
+//   key / values    KTXorientation S=r,T=u (first row at the bottom, like every texture here)
+//                   g4g.source "<size> <time>" of the image it was made from
+//   levels          numberOfMipmapLevels * (unsigned imageSize, imageSize bytes of blocks), level 0 first
+// numbers are stored in the machine's own byte order, a cache from another kind of machine fails the endianness check
+// the cache is stale as soon as the image's size or modification time differ from the ones recorded in it
+
+#define TEXTURE_CACHE_EXTENSION ".g4gtex"
+#define TEXTURE_CACHE_VERSION 1      // bumped when the encoder changes, stored in g4g.source
+
+// the GL internal formats of the blocks (GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+// GL_COMPRESSED_RG_RGTC2), they are what KTX records
+#define TEXTURE_FORMAT_BC1 0x83F0u
+#define TEXTURE_FORMAT_BC3 0x83F3u
+#define TEXTURE_FORMAT_BC5 0x8DBDu
+
+struct TextureCacheHeader
+{
+    unsigned endianness;            /// 0x04030201
+    unsigned glType, glTypeSize, glFormat;
+    unsigned glInternalFormat, glBaseInternalFormat;
+    unsigned pixelWidth, pixelHeight, pixelDepth;
+    unsigned numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+    unsigned bytesOfKeyValueData;
+};
+
+// a mip chain of blocks, either encoded here or mapped from a cache
+struct CompressedImage {
+    unsigned format = 0;                        /// one of the TEXTURE_FORMAT_ above, 0 when there's nothing
+    int width = 0, height = 0;
+    std::vector<const unsigned char*> levels;   /// level 0 and down to 1x1, into blocks or file
+    std::vector<size_t> levelBytes;
+    std::vector<unsigned char> blocks;
+    std::unique_ptr<MappedFile> file;
+};
+
+// bytes of one level
+size_t compressedLevelBytes(unsigned format, int width, int height);
+
+// encodes image and its mipmaps (see buildMipmaps()), the blocks are spread over ThreadPool::shared()
+// false when the image is empty
+bool compressImage(const DecodedImage& image, CompressedImage& out);
+
+void freeCompressed(CompressedImage& image);
+
+class TextureCache
+{
+public:
+    // maps the cache for imagePath into image, false when there is none, it is stale or it doesn't make sense
+    static bool load(const char* imagePath, CompressedImage& image);
+
+    // writes the cache for imagePath, false (and no cache) when it couldn't be written
+    static bool write(const char* imagePath, const CompressedImage& image);
+
+    static std::string pathFor(const char* imagePath) { return std::string(imagePath) + TEXTURE_CACHE_EXTENSION; }
+};
@@ -0,0 +1,350 @@
+//
+// the texture memory budget, see TextureResidency.h
+//
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+#include "TextureResidency.h"
+#include "TextureCache.h"
+#include "AssetLoader.h"
+#include "textures.h"
+
+int textureBudgetMB = 1024;
+
+struct Resident {
+    unsigned int target = GL_TEXTURE_2D;
+    std::string path;                   /// empty for the ones that are never cut down
+    bool compressed = false;
+    int internalFormat = 0;
+    unsigned int format = GL_RGBA;      /// what uncompressed levels are read back and specified as
+    int width = 0, height = 0;          /// of level 0 at full size
+    std::vector<size_t> levelBytes;     /// the full size chain, every face of a cube map together
+    unsigned int dropped = 0;           /// levels cut off the top
+    unsigned int lastSampled = 0;       /// frame
+    unsigned int serial = 0;            /// tells a texture from a later one with the same name
+    bool restoring = false;
+
+    size_t bytes(unsigned int from) const
+    {
+        size_t total = 0;
+        for (size_t level = from; level < levelBytes.size(); level++)
+            total += levelBytes[level];
+        return total;
+    }
+    size_t bytes() const { return bytes(dropped); }
+
+    bool canDrop() const { return !path.empty() && !restoring && std::max(width, height) >> dropped > TEXTURE_RESIDENT_FLOOR; }
+};
+
+static std::unordered_map<unsigned int, Resident> residents;
+static std::map<unsigned int, size_t> renderbuffers;
+static unsigned int frame = 1, serials = 0, restoring = 0;
+static bool overBudget = false;
+
+void trackTexture(unsigned int tNum, unsigned int target, const char* path)
+{
+    if (tNum == 0)
+        return;
+
+    Resident r;
+    r.target = target;
+    r.serial = ++serials;
+    r.lastSampled = frame;
+
+    glBindTexture(target, tNum);
+    unsigned int face = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+    size_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    int channels = 0, bitsPerChannel = 0;
+
+    // the levels GL has, an undefined one is 0x0
+    for (int level = 0; level < 32; level++) {
+        int width = 0, height = 0, compressed = 0;
+        glGetTexLevelParameteriv(face, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(face, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0)
+            break;
+        glGetTexLevelParameteriv(face, level, GL_TEXTURE_COMPRESSED, &compressed);
+
+        size_t bytes;
+        if (compressed) {
+            int size = 0;
+            glGetTexLevelParameteriv(face, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes = (size_t)size;
+        }
+        else {
+            static const unsigned int components[6] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+                GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE };
+            int bits = 0;
+            for (int c = 0; c < 6; c++) {
+                int size = 0;
+                glGetTexLevelParameteriv(face, level, components[c], &size);
+                bits += size;
+                if (level == 0 && c < 4 && size > 0) {
+                    channels++;
+                    bitsPerChannel = std::max(bitsPerChannel, size);
+                }
+            }
+            bytes = (size_t)width * height * ((bits + 7) / 8);
+        }
+
+        if (level == 0) {
+            r.width = width;
+            r.height = height;
+            r.compressed = compressed != 0;
+            glGetTexLevelParameteriv(face, 0, GL_TEXTURE_INTERNAL_FORMAT, &r.internalFormat);
+        }
+        r.levelBytes.push_back(bytes * faces);
+    }
+
+    // only a 2D texture with all its levels and bytes that read back as they went in can be cut down
+    r.format = channels == 4 ? GL_RGBA : channels == 3 ? GL_RGB : channels == 2 ? GL_RG : GL_RED;
+    if (path && target == GL_TEXTURE_2D && r.levelBytes.size() > 1 && (r.compressed || bitsPerChannel == 8))
+        r.path = path;
+
+    if (r.levelBytes.empty())
+        residents.erase(tNum);
+    else
+        residents[tNum] = std::move(r);
+}
+
+void trackRenderbuffer(unsigned int rbo)
+{
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    static const unsigned int components[6] = { GL_RENDERBUFFER_RED_SIZE, GL_RENDERBUFFER_GREEN_SIZE, GL_RENDERBUFFER_BLUE_SIZE,
+        GL_RENDERBUFFER_ALPHA_SIZE, GL_RENDERBUFFER_DEPTH_SIZE, GL_RENDERBUFFER_STENCIL_SIZE };
+    int width = 0, height = 0, samples = 0, bits = 0;
+    glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+    glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+    glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_SAMPLES, &samples);
+    for (int c = 0; c < 6; c++) {
+        int size = 0;
+        glGetRenderbufferParameteriv(GL_RENDERBUFFER, components[c], &size);
+        bits += size;
+    }
+    renderbuffers[rbo] = (size_t)width * height * std::max(samples, 1) * ((bits + 7) / 8);
+}
+
+void untrackTexture(unsigned int tNum)
+{
+    residents.erase(tNum);
+}
+
+void textureSampled(unsigned int tNum)
+{
+    auto r = residents.find(tNum);
+    if (r != residents.end())
+        r->second.lastSampled = frame;
+}
+
+// puts levels first .. of the full size chain in as levels 0 .. of the texture, the ones below that are emptied
+static void specifyLevels(unsigned int tNum, Resident& r, unsigned int first, const std::vector<const unsigned char*>& levels)
+{
+    unsigned int resident = (unsigned int)r.levelBytes.size() - r.dropped;
+
+    glBindTexture(GL_TEXTURE_2D, tNum);
+    // rows of an RGB level needn't start on 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int i = 0; i < levels.size(); i++) {
+        int width = std::max(1, r.width >> (first + i)), height = std::max(1, r.height >> (first + i));
+        if (r.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, (int)i, r.internalFormat, width, height, 0, (int)r.levelBytes[first + i], levels[i]);
+        else
+            glTexImage2D(GL_TEXTURE_2D, (int)i, r.internalFormat, width, height, 0, r.format, GL_UNSIGNED_BYTE, levels[i]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (unsigned int i = (unsigned int)levels.size(); i < resident; i++)
+        glTexImage2D(GL_TEXTURE_2D, (int)i, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)levels.size() - 1);
+    r.dropped = first;
+}
+
+// cuts count levels off the top, the rest are read back and specified again that many levels up
+// the read back waits for the GPU, but it is only the small levels and only when over budget
+static void dropLevels(unsigned int tNum, Resident& r, unsigned int count)
+{
+    unsigned int first = r.dropped + count;
+    std::vector<std::vector<unsigned char>> kept(r.levelBytes.size() - first);
+    std::vector<const unsigned char*> levels;
+
+    glBindTexture(GL_TEXTURE_2D, tNum);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (unsigned int i = 0; i < kept.size(); i++) {
+        kept[i].resize(r.levelBytes[first + i]);
+        if (r.compressed)
+            glGetCompressedTexImage(GL_TEXTURE_2D, (int)(count + i), kept[i].data());
+        else
+            glGetTexImage(GL_TEXTURE_2D, (int)(count + i), r.format, GL_UNSIGNED_BYTE, kept[i].data());
+        levels.push_back(kept[i].data());
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    specifyLevels(tNum, r, first, levels);
+}
+
+// reads the file again on the loader thread and puts levels first .. back in
+static void restoreLevels(unsigned int tNum, Resident& r, unsigned int first)
+{
+    struct Restore {
+        DecodedImage image;
+        CompressedImage blocks;
+    };
+    std::shared_ptr<Restore> restore = std::make_shared<Restore>();
+    std::string path = r.path;
+    unsigned int serial = r.serial;
+    bool compressed = r.compressed;
+
+    r.restoring = true;
+    restoring++;
+
+    loadInBackground(
+        [restore, path, compressed]() {
+            if (compressed && TextureCache::load(path.c_str(), restore->blocks))
+                return;
+            if (decodeImage(path.c_str(), restore->image)) {
+                buildMipmaps(restore->image);
+                if (compressed) {
+                    compressImage(restore->image, restore->blocks);
+                    freeImage(restore->image);
+                }
+            }
+        },
+        [restore, tNum, serial, first, path, compressed]() {
+            restoring--;
+            auto found = residents.find(tNum);
+            if (found != residents.end() && found->second.serial == serial) {
+                Resident& r = found->second;
+                r.restoring = false;
+
+                // the file has to give back exactly the levels that were there
+                std::vector<const unsigned char*> levels;
+                for (unsigned int level = first; level < r.levelBytes.size(); level++) {
+                    if (compressed) {
+                        if (restore->blocks.format == (unsigned int)r.internalFormat && level < restore->blocks.levels.size() &&
+                            restore->blocks.levelBytes[level] == r.levelBytes[level])
+                            levels.push_back(restore->blocks.levels[level]);
+                    }
+                    else if (restore->image.pixels && level <= restore->image.mipmaps.size()) {
+                        const unsigned char* pixels = level == 0 ? restore->image.pixels : restore->image.mipmaps[level - 1].data();
+                        size_t bytes = (size_t)std::max(1, restore->image.width >> level) * std::max(1, restore->image.height >> level) * restore->image.channels;
+                        if (bytes == r.levelBytes[level])
+                            levels.push_back(pixels);
+                    }
+                }
+
+                if (levels.size() == r.levelBytes.size() - first)
+                    specifyLevels(tNum, r, first, levels);
+                else {
+                    // it'll stay the way it is, trying again won't help
+                    std::cout << path << " has changed since it was loaded, it stays at " << std::max(1, r.width >> r.dropped) << " x "
+                        << std::max(1, r.height >> r.dropped) << "\n";
+                    r.path.clear();
+                }
+            }
+            freeImage(restore->image);
+            freeCompressed(restore->blocks);
+            return true;
+        });
+}
+
+static size_t totalBytes()
+{
+    size_t total = 0;
+    for (const auto& [tNum, r] : residents)
+        total += r.bytes();
+    for (const auto& [rbo, bytes] : renderbuffers)
+        total += bytes;
+    return total;
+}
+
+void updateTextureResidency()
+{
+    frame++;
+    if (textureBudgetMB <= 0)
+        return;
+
+    size_t budget = (size_t)textureBudgetMB << 20;
+    size_t total = totalBytes();
+
+    if (total > budget) {
+        // least recently sampled first, the bigger one first of two sampled together
+        std::vector<std::pair<unsigned int, Resident*>> candidates;
+        for (auto& [tNum, r] : residents)
+            if (r.canDrop())
+                candidates.push_back({ tNum, &r });
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            return a.second->lastSampled != b.second->lastSampled ? a.second->lastSampled < b.second->lastSampled : a.second->bytes() > b.second->bytes();
+        });
+
+        unsigned int cut = 0;
+        size_t before = total;
+        for (auto& [tNum, r] : candidates) {
+            if (total <= budget)
+                break;
+            // as many levels as it takes, in one go
+            unsigned int count = 0;
+            size_t bytes = r->bytes();
+            while (total - bytes + r->bytes(r->dropped + count) > budget && std::max(r->width, r->height) >> (r->dropped + count) > TEXTURE_RESIDENT_FLOOR)
+                count++;
+            if (count == 0)
+                continue;
+            dropLevels(tNum, *r, count);
+            total = total - bytes + r->bytes();
+            cut++;
+        }
+
+        if (cut)
+            std::cout << "cut " << cut << (cut == 1 ? " texture" : " textures") << " down from " << before / (1 << 20) << " MB to " << total / (1 << 20)
+                << " MB for a " << textureBudgetMB << " MB budget\n";
+        if (total > budget && !overBudget)
+            std::cout << "textures are still " << (total - budget) / (1 << 20) << " MB over the budget with everything that can be cut down cut down\n";
+        overBudget = total > budget;
+        return;
+    }
+    overBudget = false;
+
+    // one texture at a time comes back, the most recently sampled one that wants to, with what fits
+    if (restoring)
+        return;
+    unsigned int best = 0;
+    Resident* wanted = NULL;
+    for (auto& [tNum, r] : residents)
+        if (r.dropped > 0 && !r.path.empty() && !r.restoring && frame - r.lastSampled < TEXTURE_IDLE_FRAMES &&
+            (wanted == NULL || r.lastSampled > wanted->lastSampled)) {
+            best = tNum;
+            wanted = &r;
+        }
+    if (wanted == NULL)
+        return;
+
+    unsigned int first = wanted->dropped;
+    while (first > 0 && total - wanted->bytes() + wanted->bytes(first - 1) <= budget)
+        first--;
+    if (first < wanted->dropped)
+        restoreLevels(best, *wanted, first);
+}
+
+TextureResidencyStats textureResidency()
+{
+    TextureResidencyStats stats;
+    for (const auto& [tNum, r] : residents) {
+        stats.bytes += r.bytes();
+        stats.fullBytes += r.bytes(0);
+        stats.textures++;
+        stats.reduced += r.dropped > 0;
+    }
+    for (const auto& [rbo, bytes] : renderbuffers) {
+        stats.bytes += bytes;
+        stats.fullBytes += bytes;
+    }
+    stats.restoring = restoring;
+    return stats;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+// how much GL memory the textures (and the framebuffers' renderbuffers) take, and a budget for it
+//
+// a texture is tracked once all of its levels are in, at the bytes GL was asked for (a driver may pad RGB
+// out to RGBA on top of that)
+// when the total goes over textureBudgetMB the textures that were loaded from a file are cut down, the least
+// recently sampled first : the top levels are read back and dropped, each one quartering the texture, down to
+// TEXTURE_RESIDENT_FLOOR texels on a side, the texture name stays the same so the materials never notice
+// a cut down texture that is being sampled again gets its levels back from the file in the background
+// (see AssetLoader.h), as many of them as fit under the budget
+// render targets, the sky and the raster and ray traced textures are counted but never cut down
+
+#define TEXTURE_RESIDENT_FLOOR 64
+#define TEXTURE_IDLE_FRAMES 120    // not sampled for this many frames and a texture isn't wanted back
+
+extern int textureBudgetMB;     /// 0 for no budget
+
+// path, when there is one, is the image file the texture can be read back from, which lets it be cut down
+void trackTexture(unsigned int tNum, unsigned int target, const char* path = NULL);
+void trackRenderbuffer(unsigned int rbo);
+void untrackTexture(unsigned int tNum);
+
+// call whenever tNum is bound for drawing
+void textureSampled(unsigned int tNum);
+
+// call once a frame from the render thread, cuts textures down or brings them back
+void updateTextureResidency();
+
+struct TextureResidencyStats {
+    size_t bytes = 0;           /// everything tracked, as it is now
+    size_t fullBytes = 0;       /// and with every texture at full size
+    unsigned textures = 0, reduced = 0, restoring = 0;
+};
+TextureResidencyStats textureResidency();
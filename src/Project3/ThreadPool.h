@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+
+// a small work-stealing thread pool
+//
+// every worker owns a queue of tasks, it takes work from the front of its own queue
+// and when that runs dry it steals from the back of the other queues
+// the thread calling parallelFor() pitches in as well, so a pool of N threads has N-1 workers
+// several threads may call parallelFor() on the same pool at the same time, a caller only ever runs tasks
+// of its own call, so the render thread waiting on a few tiles never ends up parsing the loader thread's model
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        // one queue per thread, the last one belongs to whoever calls parallelFor()
+        for (unsigned i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+
+        for (unsigned i = 0; i + 1 < threads; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            quit = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& t : workers)
+            t.join();
+    }
+
+    // total number of threads that do work, including the caller of parallelFor()
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // queue a task and return immediately (a single threaded pool just runs it)
+    void submit(std::function<void()> task)
+    {
+        if (workers.empty()) {
+            task();
+            return;
+        }
+        push((unsigned)(next++ % queues.size()), std::move(task), NULL);
+        wake.notify_one();
+    }
+
+    // run fn(0) .. fn(count-1) across the pool and wait until all of them are done
+    void parallelFor(unsigned count, const std::function<void(unsigned)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        if (workers.empty()) {
+            for (unsigned i = 0; i < count; i++)
+                fn(i);
+            return;
+        }
+
+        std::atomic<unsigned> remaining(count);
+
+        // the tasks are tagged with this call, see runOne()
+        for (unsigned i = 0; i < count; i++)
+            push(i % queues.size(), [&fn, &remaining, i]() { fn(i); remaining--; }, &remaining);
+
+        wake.notify_all();
+
+        // help out until our tasks are finished, only with our own tasks, the workers take the rest
+        while (remaining > 0) {
+            if (!runOne((unsigned)queues.size() - 1, &remaining))
+                std::this_thread::yield();
+        }
+    }
+
+    // a pool sized to the machine, shared by anyone who doesn't need a specific thread count
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    struct Task {
+        std::function<void()> run;
+        const void* batch;      // the parallelFor() call it belongs to, NULL for submit()
+    };
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<unsigned> next{ 0 };
+    std::atomic<int> pending{ 0 };
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool quit = false;
+
+    void push(unsigned q, std::function<void()> task, const void* batch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->lock);
+            queues[q]->tasks.push_back({ std::move(task), batch });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            pending++;
+        }
+    }
+
+    // a worker passes batch NULL and takes any task, a waiting parallelFor() caller only takes its own
+    bool runOne(unsigned home, const void* batch = NULL)
+    {
+        std::function<void()> task;
+
+        // own queue first (front), then steal from the others (back)
+        for (unsigned i = 0; i < queues.size() && !task; i++) {
+            Queue& q = *queues[(home + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.lock);
+
+            // the caller's tasks are usually at the end it looks at, other callers' may sit in between
+            auto mine = [batch](const Task& t) { return batch == NULL || t.batch == batch; };
+            auto taken = q.tasks.end();
+            if (i == 0)
+                taken = std::find_if(q.tasks.begin(), q.tasks.end(), mine);
+            else {
+                auto last = std::find_if(q.tasks.rbegin(), q.tasks.rend(), mine);
+                if (last != q.tasks.rend())
+                    taken = std::prev(last.base());
+            }
+            if (taken != q.tasks.end()) {
+                task = std::move(taken->run);
+                q.tasks.erase(taken);
+            }
+        }
+
+        if (!task)
+            return false;
+
+        pending--;
+        task();
+        return true;
+    }
+
+    void workerLoop(unsigned id)
+    {
+        for (;;) {
+            if (runOne(id))
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleepLock);
+            wake.wait(lock, [this]() { return quit || pending > 0; });
+
+            if (quit)
+                return;
+        }
+    }
+};
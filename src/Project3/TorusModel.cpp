@@ -14,6 +14,7 @@
 #include <filesystem>
 
 #include "renderer.h"
+#include "MeshOptimizer.h"
 
 TorusModel::TorusModel(Material* material, glm::mat4 m)
 {
@@ -31,7 +32,7 @@ TorusModel::TorusModel(Material* material, glm::mat4 m)
     glGenBuffers(1, &EBO);
 
     std::vector<float> verts;
-    std::vector<int> indices;
+    std::vector<unsigned int> indices;
 
     int sides = 40, cs_sides = 20;
     float radius = .35;
@@ -88,26 +89,18 @@ TorusModel::TorusModel(Material* material, glm::mat4 m)
         }
     }
 
+    optimizeMesh("torus", verts.data(), 8, (unsigned int)(verts.size() / 8), indices.data(), indices.size(), std::vector<size_t>(), true, true);
+
     indexCount = indices.size();
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * 4, &verts[0], GL_STATIC_DRAW);
+
+    // position, normal and texture coord attributes
+    uploadVertices(&verts[0], 8, (unsigned int)(verts.size() / 8), 3, 6);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * 4, &indices[0], GL_STATIC_DRAW);
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // normal vector attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // texture coord attribute
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-
     setupColorAttrib();
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -0,0 +1,73 @@
+//
+// the packed vertex layout, see VertexPacking.h
+// nothing in here touches GL, Renderer::setupPackedAttribs() describes the layout to it
+//
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "VertexPacking.h"
+
+using namespace glm;
+
+bool packVertices = false;
+
+vec2 octEncode(vec3 n)
+{
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (sum == 0.0f)
+        return vec2(0.0f);
+    n /= sum;
+
+    // the lower half of the octahedron folds out over the corners of the square
+    vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+        e = (vec2(1.0f) - abs(vec2(n.y, n.x))) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return e;
+}
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+    if (n.z < 0.0f) {
+        vec2 folded = (vec2(1.0f) - abs(vec2(n.y, n.x))) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return normalize(n);
+}
+
+void packVertexData(const float* vertices, unsigned int floatsPerVertex, unsigned int count, unsigned int normalOffset,
+    unsigned int texCoordOffset, std::vector<PackedVertex>& packed, vec3& min, vec3& extent)
+{
+    min = vec3(0.0f);
+    vec3 max(0.0f);
+    for (unsigned int v = 0; v < count; v++) {
+        vec3 p(vertices[(size_t)v * floatsPerVertex], vertices[(size_t)v * floatsPerVertex + 1], vertices[(size_t)v * floatsPerVertex + 2]);
+        min = v == 0 ? p : glm::min(min, p);
+        max = v == 0 ? p : glm::max(max, p);
+    }
+    // a flat mesh still needs something to divide by
+    extent = glm::max(max - min, vec3(1e-20f));
+
+    packed.resize(count);
+    for (unsigned int v = 0; v < count; v++) {
+        const float* vertex = vertices + (size_t)v * floatsPerVertex;
+        PackedVertex& out = packed[v];
+
+        for (int k = 0; k < 3; k++)
+            out.position[k] = (unsigned short)std::min(65535.0f, std::max(0.0f, roundf((vertex[k] - min[k]) / extent[k] * 65535.0f)));
+        out.position[3] = 0;
+
+        vec2 e = octEncode(vec3(vertex[normalOffset], vertex[normalOffset + 1], vertex[normalOffset + 2]));
+        out.normal[0] = (short)roundf(clamp(e.x, -1.0f, 1.0f) * 32767.0f);
+        out.normal[1] = (short)roundf(clamp(e.y, -1.0f, 1.0f) * 32767.0f);
+
+        out.texCoord[0] = packHalf1x16(vertex[texCoordOffset]);
+        out.texCoord[1] = packHalf1x16(vertex[texCoordOffset + 1]);
+    }
+}
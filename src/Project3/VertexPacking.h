@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// the packed vertex layout, 16 bytes instead of 8 floats (32), for models created while packVertices is set
+//   position    x, y, z as 16 bit fractions of the mesh's bounding box, the shaders scale them back with
+//               the packedMin and packedExtent uniforms
+//   normal      octahedral, two 16 bit signed fractions, decoded with octDecode() in the shaders
+//   texCoord    two half floats, which GL turns back into floats by itself
+// the shaders only decode when the packed uniform is set, Renderer::setPackingUniforms() takes care of that
+struct PackedVertex {
+    unsigned short position[4];     /// the 4th is padding, to keep the normal on 4 bytes
+    short normal[2];
+    unsigned short texCoord[2];
+};
+
+// off by default, flip it before models are created (only the ones created afterwards are packed), the
+// "pack vertices of new models" checkbox in the sandbox window does
+extern bool packVertices;
+
+// packs count vertices of floatsPerVertex floats each, the position first, the normal at normalOffset
+// (0 is fine for a unit sphere, whose positions are its normals) and the texture coordinate at texCoordOffset
+// returns the bounding box the positions were packed into, as its corner and size
+void packVertexData(const float* vertices, unsigned int floatsPerVertex, unsigned int count, unsigned int normalOffset,
+    unsigned int texCoordOffset, std::vector<PackedVertex>& packed, glm::vec3& min, glm::vec3& extent);
+
+// unit vector to the octahedral pair in [-1, 1] and back, a zero normal comes back as +z
+glm::vec2 octEncode(glm::vec3 n);
+glm::vec3 octDecode(glm::vec2 e);
@@ -0,0 +1,211 @@
+//
+// objcheck : writes small OBJ files with awkward faces, parses them with ModelImporter and checks the
+// triangles that come back, without a window or GL context
+//
+// usage : objcheck
+//   every face is a flat polygon with a known area, its triangles have to add up to that area and every one
+//   of them has to face the same way as the polygon, a triangle cutting across a notch fails both
+//   then one file mixes every corner format with faces that have to be skipped, too few corners or corners
+//   with something left over (1e0, 1/1/1/1, 3abc), and a face using a vertex written after it
+//   then a .g4gmesh cache is written for a small mesh, it has to load, and it has to be refused once its header
+//   claims more meshes than the file holds or one of its indices is pointed past the vertices (each refusal
+//   prints a line, those are expected)
+//   exits with 1 when anything failed, run it after touching triangulatePolygon() or the face parsing
+//
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#include <glm/glm.hpp>
+
+#include "ImportedModel.h"
+#include "MeshCache.h"
+
+// one polygon in the xy plane, written in the order given, area is what the triangles have to cover
+struct TestPolygon {
+    const char* name;
+    std::vector<glm::vec2> corners;
+    float area;
+};
+
+static std::vector<glm::vec2> reversed(std::vector<glm::vec2> corners)
+{
+    return std::vector<glm::vec2>(corners.rbegin(), corners.rend());
+}
+
+static bool checkPolygon(const TestPolygon& test, const std::string& path)
+{
+    {
+        std::ofstream obj(path);
+        for (const glm::vec2& c : test.corners)
+            obj << "v " << c.x << " " << c.y << " 0\n";
+        obj << "f";
+        for (size_t i = 0; i < test.corners.size(); i++)
+            obj << " " << i + 1;
+        obj << "\n";
+    }
+
+    // which way the polygon faces, twice its signed area
+    float winding = 0.0f;
+    for (size_t i = 0; i < test.corners.size(); i++) {
+        glm::vec2 a = test.corners[i], b = test.corners[(i + 1) % test.corners.size()];
+        winding += a.x * b.y - a.y * b.x;
+    }
+
+    ModelImporter importer;
+    importer.parseOBJ(path.c_str(), 1);
+    const std::vector<glm::vec3>& verts = importer.getVertices();
+
+    bool ok = verts.size() == 3 * (test.corners.size() - 2);
+    float area = 0.0f;
+    for (size_t i = 0; i + 2 < verts.size(); i += 3) {
+        float z = glm::cross(verts[i + 1] - verts[i], verts[i + 2] - verts[i]).z;
+        if (z * winding < 0.0f) {
+            std::cout << "  triangle " << i / 3 << " faces the wrong way\n";
+            ok = false;
+        }
+        area += fabsf(z) / 2;
+    }
+    std::cout << "  " << verts.size() / 3 << " triangles, area " << area << " (" << test.area << " expected)\n";
+    if (fabsf(area - test.area) > 1e-4f)
+        ok = false;
+    return ok;
+}
+
+// v, v/vt/vn, negative v//vn and v/vt corners make faces, the rest of the faces have to be skipped rather
+// than read as some other face (the importer prints a line for each kind of skip, those are expected)
+static bool checkCorners(const std::string& path)
+{
+    {
+        std::ofstream obj(path);
+        obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nvt 1 1\nvn 0 0 1\n";
+        obj << "f 1 2 3\nf 1/1/1 2/2/1 3/1/1\nf -4//1 -3//1 -2//1\nf 1/1 2/2 3/1\n";
+        obj << "f 1 2\nf 1e0 2 3\nf 1/1/1/1 2 3\nf 3abc 1 2\n";
+        obj << "f 1 2 5\nv 5 5 5\n";
+    }
+
+    ModelImporter importer;
+    importer.parseOBJ(path.c_str(), 1);
+    const std::vector<glm::vec3>& verts = importer.getVertices();
+
+    std::cout << "  " << verts.size() / 3 << " triangles (5 expected)\n";
+    bool ok = verts.size() == 15;
+    if (ok && verts[14] != glm::vec3(5, 5, 5)) {
+        std::cout << "  the vertex written after its face wasn't used\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// a quad as ObjModel would cache it, loaded back, then with a mesh count it can't hold, then with its last index out of range
+static bool checkMeshCache(const std::string& path)
+{
+    {
+        std::ofstream obj(path);
+        obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n";
+    }
+    std::vector<float> vertices;
+    for (int v = 0; v < 4; v++) {
+        float corner[8] = { float(v == 1 || v == 2), float(v >= 2), 0, 0, 0, 1, 0, 0 };
+        vertices.insert(vertices.end(), corner, corner + 8);
+    }
+    std::vector<unsigned short> indices = { 0, 1, 2, 0, 2, 3 };
+    std::vector<objLOD> lods = { { 0, 6, 0.0f, std::vector<unsigned int>() } };
+
+    bool ok = MeshCache::write(path.c_str(), vertices.data(), 4, indices.data(), 6, sizeof(unsigned short),
+        std::vector<objMesh>(), std::vector<std::string>(), lods);
+    ok = ok && MeshCache().load(path.c_str());
+    if (!ok) {
+        std::cout << "  a good cache didn't load\n";
+        return false;
+    }
+
+    std::string cachePath = MeshCache::pathFor(path.c_str());
+    // sized before it is read, a count like this has to be refused rather than allocated
+    auto writeMeshCount = [&](unsigned count) {
+        std::fstream cache(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+        cache.seekp(offsetof(MeshCacheHeader, meshCount));
+        cache.write((const char*)&count, sizeof(count));
+    };
+    writeMeshCount(0xFFFFFFFF);
+    if (MeshCache().load(path.c_str())) {
+        std::cout << "  a cache claiming more meshes than it holds loaded\n";
+        ok = false;
+    }
+    writeMeshCount(0);
+
+    {
+        std::fstream cache(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+        unsigned short past = 4;
+        cache.seekp(sizeof(MeshCacheHeader) + vertices.size() * sizeof(float) + 5 * sizeof(unsigned short));
+        cache.write((const char*)&past, sizeof(past));
+    }
+    // the change keeps the OBJ's size and time, so only the index check can catch it
+    if (MeshCache().load(path.c_str())) {
+        ok = false;
+        std::cout << "  a cache with an index past its vertices loaded\n";
+    }
+    std::filesystem::remove(cachePath);
+    return ok;
+}
+
+int main()
+{
+    // an L with its notch in the top right, the reflex corner (1, 1) sits on the diagonal from (0, 2) to (2, 0)
+    std::vector<glm::vec2> l = { {0, 0}, {2, 0}, {2, 1}, {1, 1}, {1, 2}, {0, 2} };
+    // the same with a flat corner halfway along the bottom
+    std::vector<glm::vec2> l7 = { {0, 0}, {1, 0}, {2, 0}, {2, 1}, {1, 1}, {1, 2}, {0, 2} };
+    // a U, both reflex corners lie on diagonals from the outside ones
+    std::vector<glm::vec2> u = { {0, 0}, {3, 0}, {3, 3}, {2, 3}, {2, 1}, {1, 1}, {1, 3}, {0, 3} };
+    // a plus, four reflex corners on the diagonals between the arms
+    std::vector<glm::vec2> plus = { {1, 0}, {2, 0}, {2, 1}, {3, 1}, {3, 2}, {2, 2}, {2, 3}, {1, 3}, {1, 2}, {0, 2}, {0, 1}, {1, 1} };
+
+    std::vector<TestPolygon> tests = {
+        { "quad", { {0, 0}, {1, 0}, {1, 1}, {0, 1} }, 1.0f },
+        { "arrow", { {0, 0}, {2, 1}, {4, 0}, {2, 3} }, 4.0f },
+        { "l-hexagon", l, 3.0f },
+        { "l-hexagon-reversed", reversed(l), 3.0f },
+        { "l-flat-corner", l7, 3.0f },
+        { "l-flat-corner-reversed", reversed(l7), 3.0f },
+        { "u", u, 7.0f },
+        { "u-reversed", reversed(u), 7.0f },
+        { "plus", plus, 5.0f },
+        { "plus-reversed", reversed(plus), 5.0f },
+    };
+
+    std::string path = (std::filesystem::temp_directory_path() / "objcheck.obj").string();
+
+    unsigned failed = 0;
+    for (const TestPolygon& test : tests) {
+        std::cout << test.name << " (" << test.corners.size() << " corners)\n";
+        if (!checkPolygon(test, path)) {
+            std::cout << "  FAILED\n";
+            failed++;
+        }
+    }
+
+    std::cout << "corner formats\n";
+    if (!checkCorners(path)) {
+        std::cout << "  FAILED\n";
+        failed++;
+    }
+
+    std::cout << "mesh cache\n";
+    if (!checkMeshCache(path)) {
+        std::cout << "  FAILED\n";
+        failed++;
+    }
+    std::filesystem::remove(path);
+
+    size_t checks = tests.size() + 2;
+    if (failed)
+        std::cout << failed << " of " << checks << " checks FAILED\n";
+    else
+        std::cout << checks << " of " << checks << " checks ok\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+//
+// objbench : times ModelImporter on OBJ files, without a window or GL context
+//
+// usage : objbench [-n repeats] [-t threads] [-v] file.obj [more.obj ...]
+//   every file is parsed repeats times (default 3) and the best and average times are reported,
+//   the best run is the one to compare, the first one also pays for reading the file from disk
+//   threads is passed to parseOBJ, 0 (the default) uses every core and 1 parses on the calling thread
+//   -v has the importer report each parse as well (its MB/s and chunks, see importerVerbose)
+//
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include "ImportedModel.h"
+
+int main(int argc, char** argv)
+{
+    unsigned repeats = 3, threads = 0;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) repeats = std::max(1, atoi(argv[++i]));
+        else if (arg == "-t" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (arg == "-v") importerVerbose = true;
+        else if (arg[0] != '-') files.push_back(argv[i]);
+        else {
+            files.clear();
+            break;
+        }
+    }
+    if (files.empty()) {
+        std::cout << "usage : objbench [-n repeats] [-t threads] [-v] file.obj [more.obj ...]\n";
+        return 1;
+    }
+
+    for (const char* file : files) {
+        double best = 1e30, total = 0;
+        int vertices = 0;
+
+        for (unsigned r = 0; r < repeats; r++) {
+            auto start = std::chrono::steady_clock::now();
+            {
+                ModelImporter importer;
+                importer.parseOBJ(file, threads);
+                vertices = importer.getNumVertices();
+            }
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, t);
+            total += t;
+        }
+        std::error_code error;
+        double megabytes = std::filesystem::file_size(file, error) / (1024.0 * 1024.0);
+        if (error)
+            continue;   // parseOBJ() has said it couldn't open it
+        std::cout << file << " : " << megabytes << " MB, " << vertices / 3 << " triangles, best " << best * 1000 << " ms ("
+            << megabytes / best << " MB/s), average " << total / repeats * 1000 << " ms over " << repeats << " runs\n";
+    }
+    return 0;
+}
@@ -0,0 +1,302 @@
+//
+// rtcli : the CPU ray tracer without a window or GL context
+// renders a scene file (or the sandbox's demo spheres) to a PPM or PNG and reports how fast it went,
+// so the ray tracer can be timed on machines that have no display
+//
+// usage : rtcli [options] [scene.txt]
+//   -o file     output image, .png or .ppm (default render.png)
+//   -w N -h N   resolution (default 512 x 512)
+//   -spp N      path traced samples per pixel, one pass each, 0 traces one Whitted style ray per pixel (default 16)
+//   -t N        threads, 0 uses every core (default 0)
+//   -aa N       with -spp 0, up to N rays in pixels at edges (adaptive antialiasing, default 1 is off)
+//   -aac X      how much a pixel must differ from a neighbour to be antialiased (default 0.1)
+//   -bench      times the scalar and SIMD sphere kernels on the primary rays of the scene instead of rendering
+//
+// scene files have one item per line, # starts a comment
+//   camera  px py pz  tx ty tz  fov
+//   sphere  cx cy cz  radius  r g b  [reflection transparency]
+//   light   cx cy cz  radius  r g b
+//   obj     file.obj  r g b  [tx ty tz [scale]]       (relative to the scene file)
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "ThreadPool.h"
+#include "RayTracing.h"
+
+static std::string directoryOf(const std::string& path)
+{
+    size_t i = path.find_last_of("/\\");
+    return i == std::string::npos ? "" : path.substr(0, i + 1);
+}
+
+static bool loadScene(const char* filePath, RayScene& scene)
+{
+    std::ifstream file(filePath);
+    if (!file.good()) {
+        std::cout << "can't open scene " << filePath << "\n";
+        return false;
+    }
+
+    std::string line, type;
+    int lineNumber = 0;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream in(line);
+        if (!(in >> type) || type[0] == '#')
+            continue;
+
+        bool ok = true;
+
+        if (type == "camera") {
+            ok = !(in >> scene.camera.position.x >> scene.camera.position.y >> scene.camera.position.z
+                >> scene.camera.target.x >> scene.camera.target.y >> scene.camera.target.z >> scene.camera.fov).fail();
+        }
+        else if (type == "sphere") {
+            Vec3f c, color;
+            float radius, reflection = 0, transparency = 0;
+            ok = !(in >> c.x >> c.y >> c.z >> radius >> color.x >> color.y >> color.z).fail();
+            in >> reflection >> transparency; // optional
+            scene.spheres.push_back(Sphere(c, radius, color, reflection, transparency));
+        }
+        else if (type == "light") {
+            Vec3f c, emission;
+            float radius;
+            ok = !(in >> c.x >> c.y >> c.z >> radius >> emission.x >> emission.y >> emission.z).fail();
+            scene.spheres.push_back(Sphere(c, radius, Vec3f(0), 0, 0, emission));
+        }
+        else if (type == "obj") {
+            std::string name;
+            RayMesh mesh;
+            float offset[3] = { 0, 0, 0 }, scale = 1;
+            ok = !(in >> name >> mesh.surfaceColor.x >> mesh.surfaceColor.y >> mesh.surfaceColor.z).fail();
+            in >> offset[0] >> offset[1] >> offset[2] >> scale; // optional
+
+            float m[16] = { scale, 0, 0, 0,  0, scale, 0, 0,  0, 0, scale, 0,  offset[0], offset[1], offset[2], 1 };
+            std::string objPath = directoryOf(filePath) + name;
+            if (ok && !addOBJToRayScene(scene, objPath.c_str(), mesh, m))
+                return false;
+        }
+        else {
+            std::cout << filePath << ":" << lineNumber << " unknown item " << type << "\n";
+            return false;
+        }
+        if (!ok) {
+            std::cout << filePath << ":" << lineNumber << " not enough numbers for " << type << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writePPM(const char* filePath, const std::vector<unsigned char>& rgba, unsigned width, unsigned height)
+{
+    std::ofstream ofs(filePath, std::ios::out | std::ios::binary);
+    ofs << "P6\n" << width << " " << height << "\n255\n";
+    for (unsigned i = 0; i < width * height; i++)
+        ofs.write((const char*)&rgba[i * 4], 3);
+    return ofs.good();
+}
+
+// a PNG with stored (uncompressed) deflate blocks, bigger than it needs to be but it needs no zlib
+static bool writePNG(const char* filePath, const std::vector<unsigned char>& rgba, unsigned width, unsigned height)
+{
+    static uint32_t crcTable[256];
+    if (crcTable[1] == 0)
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+
+    std::ofstream ofs(filePath, std::ios::out | std::ios::binary);
+
+    auto put32 = [](std::vector<unsigned char>& v, uint32_t x) {
+        v.push_back(x >> 24), v.push_back(x >> 16), v.push_back(x >> 8), v.push_back(x);
+    };
+    auto chunk = [&](const char* type, const std::vector<unsigned char>& data) {
+        std::vector<unsigned char> c;
+        put32(c, (uint32_t)data.size());
+        c.insert(c.end(), type, type + 4);
+        c.insert(c.end(), data.begin(), data.end());
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 4; i < c.size(); i++)
+            crc = crcTable[(crc ^ c[i]) & 0xff] ^ (crc >> 8);
+        put32(c, crc ^ 0xffffffffu);
+        ofs.write((const char*)c.data(), c.size());
+    };
+
+    ofs.write("\x89PNG\r\n\x1a\n", 8);
+
+    std::vector<unsigned char> header;
+    put32(header, width);
+    put32(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA
+    chunk("IHDR", header);
+
+    // every row starts with filter type 0
+    std::vector<unsigned char> raw;
+    raw.reserve((width * 4 + 1) * height);
+    for (unsigned y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba.begin() + y * width * 4, rgba.begin() + (y + 1) * width * 4);
+    }
+
+    std::vector<unsigned char> z = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i += 65535) {
+        size_t n = std::min(raw.size() - i, (size_t)65535);
+        z.push_back(i + n == raw.size() ? 1 : 0);
+        z.push_back(n & 0xff), z.push_back(n >> 8), z.push_back(~n & 0xff), z.push_back((~n >> 8) & 0xff);
+        z.insert(z.end(), raw.begin() + i, raw.begin() + i + n);
+    }
+    for (unsigned char c : raw)
+        a = (a + c) % 65521, b = (b + a) % 65521;
+    put32(z, (b << 16) | a);
+    chunk("IDAT", z);
+    chunk("IEND", {});
+
+    return ofs.good();
+}
+
+// most memory the process has held at once, in bytes
+static double peakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (double)pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (double)usage.ru_maxrss;             // bytes on macOS
+#else
+    return (double)usage.ru_maxrss * 1024.0;    // kilobytes on Linux
+#endif
+#endif
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    const char* sceneFile = NULL;
+    std::string output = "render.png";
+    unsigned width = 512, height = 512, spp = 16, threads = 0;
+    RayAntialiasing aa;
+    bool bench = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-o" && hasValue) output = argv[++i];
+        else if (arg == "-w" && hasValue) width = atoi(argv[++i]);
+        else if (arg == "-h" && hasValue) height = atoi(argv[++i]);
+        else if (arg == "-spp" && hasValue) spp = atoi(argv[++i]);
+        else if (arg == "-t" && hasValue) threads = atoi(argv[++i]);
+        else if (arg == "-aa" && hasValue) aa.maxSamples = atoi(argv[++i]);
+        else if (arg == "-aac" && hasValue) aa.contrast = (float)atof(argv[++i]);
+        else if (arg == "-bench") bench = true;
+        else if (arg[0] != '-' && sceneFile == NULL) sceneFile = argv[i];
+        else {
+            std::cout << "usage : rtcli [-o image.png|image.ppm] [-w width] [-h height] [-spp samples] [-t threads] [-aa samples] [-aac contrast] [-bench] [scene.txt]\n";
+            return 1;
+        }
+    }
+    if (width == 0 || height == 0) {
+        std::cout << "bad resolution " << width << " x " << height << "\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    RayScene scene;
+    if (sceneFile) {
+        if (!loadScene(sceneFile, scene))
+            return 1;
+        scene.build();
+    }
+    else
+        demoScene(scene);
+
+    std::cout << "scene " << (sceneFile ? sceneFile : "(demo)") << " : " << scene.spheres.size() << " spheres, "
+        << scene.triangles.size() << " triangles, loaded and built in " << secondsSince(start) * 1000 << " ms\n";
+
+    if (bench) {
+        benchmarkSphereKernels(scene, width, height);
+        return 0;
+    }
+
+    ThreadPool pool(threads);
+    std::cout << width << " x " << height << ", " << (spp ? spp : 1) << (spp ? " path traced" : " Whitted") << " samples per pixel, "
+        << pool.size() << " threads, " << scene.kernels->name << " sphere kernels\n";
+    if (spp == 0 && aa.maxSamples > 1)
+        std::cout << "adaptive antialiasing, up to " << aa.maxSamples << " rays where neighbours differ by more than " << aa.contrast << "\n";
+
+    std::vector<unsigned char> image(width * height * 4);
+    RayFramebuffer fb(image.data(), width, height, RAY_PIXEL_RGBA8);
+
+    unsigned long long raysBefore = rayTracerRayCount();
+    double traceTime = 0;
+    unsigned passes = 0;
+
+    if (spp == 0) {
+        auto pass = std::chrono::steady_clock::now();
+        render(scene, fb, pool, aa);
+        traceTime = secondsSince(pass);
+        passes = 1;
+    }
+    else {
+        ProgressiveRayTracer tracer(width, height, 1, spp);
+
+        for (passes = 0; passes < spp; passes++) {
+            unsigned long long rays = rayTracerRayCount();
+            auto pass = std::chrono::steady_clock::now();
+            tracer.tracePass(scene, pool);
+            double t = secondsSince(pass);
+            traceTime += t;
+            std::cout << "  pass " << passes + 1 << " : " << t * 1000 << " ms, " << (rayTracerRayCount() - rays) / t / 1e6 << " Mrays/s\n";
+        }
+        tracer.resolve(fb);
+    }
+    unsigned long long rays = rayTracerRayCount() - raysBefore;
+
+    bool ppm = output.size() >= 4 && output.compare(output.size() - 4, 4, ".ppm") == 0;
+    bool written = ppm ? writePPM(output.c_str(), image, width, height) : writePNG(output.c_str(), image, width, height);
+    if (!written) {
+        std::cout << "couldn't write " << output << "\n";
+        return 1;
+    }
+
+    std::cout << "wrote " << output << "\n";
+    std::cout << "rays " << rays << ", " << rays / traceTime / 1e6 << " Mrays/s, " << traceTime * 1000 / passes << " ms per pass, "
+        << traceTime << " s tracing, " << secondsSince(start) << " s total, peak memory " << peakMemory() / (1024 * 1024) << " MB\n";
+
+    return 0;
+}
@@ -0,0 +1,381 @@
+//
+// texcheck : encodes made up images with the texture cache's block encoder, decodes them again and checks
+// the result, then writes, reloads and damages a cache file, without a window or GL context
+//
+// usage : texcheck [-v]
+//   every image is a solid colour, a gradient or an alpha edge, some of them not a multiple of 4 across,
+//   level 0 is decoded and each channel has to come back within the image's bound (the 565 rounding for a
+//   solid colour, what the 4 colours or 8 values of a block can reach for the others)
+//   then every image goes through TextureCache::write() and load(), the blocks have to match, and a cache
+//   that is cut short, has a level of the wrong size, misses a level or is older than its image has to be refused
+//   -v prints the cache's own messages too, the refusals are expected
+//   exits with 1 when anything failed, run it after touching the encoder or the cache format
+//
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+
+#include "TextureCache.h"
+
+// a made up image, pixel() gives the channels of (x, y) on level 0
+struct TestImage {
+    const char* name;
+    int width, height, channels;
+    unsigned format;            /// what compressImage() should pick
+    int colorBound, alphaBound; /// largest difference allowed after a round trip, per channel
+    std::function<void(int x, int y, unsigned char* pixel)> pixel;
+};
+
+// ---------------------------------------------------------------
+// the decoders, what the GPU does with the blocks
+
+static void unpack565(unsigned c, int rgb[3])
+{
+    unsigned r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+// BC1 into RGBA, the three colour mode (c0 <= c1) is decoded too although the encoder never asks for it
+static void decodeColorBlock(const unsigned char* block, unsigned char out[16][4])
+{
+    unsigned c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+    unsigned indices = block[4] | block[5] << 8 | block[6] << 16 | (unsigned)block[7] << 24;
+
+    int palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    for (int k = 0; k < 4; k++)
+        palette[k][3] = (c0 <= c1 && k == 3) ? 0 : 255;
+
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            out[i][c] = (unsigned char)palette[(indices >> (2 * i)) & 3][c];
+}
+
+// BC4, 8 values between the ends when a0 > a1, else 6 and then 0 and 255
+static void decodeValueBlock(const unsigned char* block, unsigned char out[16])
+{
+    int a0 = block[0], a1 = block[1];
+    int palette[8] = { a0, a1 };
+    for (int k = 1; k < 7; k++) {
+        if (a0 > a1)
+            palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        else if (k < 5)
+            palette[k + 1] = ((5 - k) * a0 + k * a1) / 5;
+    }
+    if (a0 <= a1) {
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    unsigned long long indices = 0;
+    for (int k = 0; k < 6; k++)
+        indices |= (unsigned long long)block[2 + k] << (8 * k);
+    for (int i = 0; i < 16; i++)
+        out[i] = (unsigned char)palette[(indices >> (3 * i)) & 7];
+}
+
+// one level back to RGBA, BC5 comes out as R R R G like the textures sample it
+static std::vector<unsigned char> decodeLevel(unsigned format, const unsigned char* blocks, int width, int height)
+{
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    unsigned bytes = format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+    int blocksAcross = (width + 3) / 4;
+
+    for (int by = 0; by < (height + 3) / 4; by++)
+        for (int bx = 0; bx < blocksAcross; bx++) {
+            const unsigned char* block = blocks + ((size_t)by * blocksAcross + bx) * bytes;
+            unsigned char texels[16][4], values[16];
+
+            if (format == TEXTURE_FORMAT_BC5) {
+                decodeValueBlock(block, values);
+                for (int i = 0; i < 16; i++)
+                    texels[i][0] = texels[i][1] = texels[i][2] = values[i];
+                decodeValueBlock(block + 8, values);
+                for (int i = 0; i < 16; i++)
+                    texels[i][3] = values[i];
+            }
+            else if (format == TEXTURE_FORMAT_BC3) {
+                decodeColorBlock(block + 8, texels);
+                decodeValueBlock(block, values);
+                for (int i = 0; i < 16; i++)
+                    texels[i][3] = values[i];
+            }
+            else
+                decodeColorBlock(block, texels);
+
+            // the part of the block past the edge of the image is thrown away
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], texels[y * 4 + x], 4);
+        }
+    return rgba;
+}
+
+// ---------------------------------------------------------------
+
+// level 0 from the image's pixel(), the rest halved from it the way buildMipmaps() does
+// (that one is in textures.cpp, which wants GL)
+static void makeImage(const TestImage& test, DecodedImage& image, std::vector<unsigned char>& pixels)
+{
+    image.width = test.width;
+    image.height = test.height;
+    image.channels = test.channels;
+    pixels.resize((size_t)test.width * test.height * test.channels);
+    for (int y = 0; y < test.height; y++)
+        for (int x = 0; x < test.width; x++)
+            test.pixel(x, y, &pixels[((size_t)y * test.width + x) * test.channels]);
+    image.pixels = pixels.data();
+
+    const unsigned char* source = image.pixels;
+    int width = image.width, height = image.height, channels = image.channels;
+    while (width > 1 || height > 1) {
+        int levelWidth = std::max(1, width / 2), levelHeight = std::max(1, height / 2);
+        std::vector<unsigned char> level((size_t)levelWidth * levelHeight * channels);
+        for (int y = 0; y < levelHeight; y++)
+            for (int x = 0; x < levelWidth; x++)
+                for (int c = 0; c < channels; c++) {
+                    int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                    int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                    level[((size_t)y * levelWidth + x) * channels + c] = (unsigned char)((source[((size_t)y0 * width + x0) * channels + c] +
+                        source[((size_t)y0 * width + x1) * channels + c] + source[((size_t)y1 * width + x0) * channels + c] +
+                        source[((size_t)y1 * width + x1) * channels + c] + 2) >> 2);
+                }
+        image.mipmaps.push_back(std::move(level));
+        source = image.mipmaps.back().data();
+        width = levelWidth;
+        height = levelHeight;
+    }
+}
+
+static const char* formatName(unsigned format)
+{
+    return format == TEXTURE_FORMAT_BC1 ? "BC1" : format == TEXTURE_FORMAT_BC3 ? "BC3" : format == TEXTURE_FORMAT_BC5 ? "BC5" : "none";
+}
+
+// encodes and decodes level 0, false when a channel is off by more than the image allows
+static bool checkEncoder(const TestImage& test, const DecodedImage& image, CompressedImage& compressed)
+{
+    if (!compressImage(image, compressed) || compressed.format != test.format) {
+        std::cout << "  encoded as " << formatName(compressed.format) << ", wanted " << formatName(test.format) << "\n";
+        return false;
+    }
+    if (compressed.levels.size() != image.mipmaps.size() + 1) {
+        std::cout << "  " << compressed.levels.size() << " levels, wanted " << image.mipmaps.size() + 1 << "\n";
+        return false;
+    }
+
+    std::vector<unsigned char> decoded = decodeLevel(compressed.format, compressed.levels[0], image.width, image.height);
+
+    int colorError = 0, alphaError = 0;
+    double squares = 0;
+    for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+        const unsigned char* p = image.pixels + i * image.channels;
+        // grey goes to all three colours, no alpha is opaque
+        int wanted[4] = { p[0], p[0], p[0], 255 };
+        if (image.channels >= 3)
+            wanted[1] = p[1], wanted[2] = p[2];
+        if (image.channels == 2 || image.channels == 4)
+            wanted[3] = p[image.channels - 1];
+
+        for (int c = 0; c < 4; c++) {
+            int error = abs(decoded[i * 4 + c] - wanted[c]);
+            if (c < 3)
+                colorError = std::max(colorError, error);
+            else
+                alphaError = std::max(alphaError, error);
+            squares += error * error;
+        }
+    }
+    double mse = squares / ((double)image.width * image.height * 4);
+    std::cout << "  " << formatName(compressed.format) << ", largest error colour " << colorError << " (" << test.colorBound
+        << " allowed) alpha " << alphaError << " (" << test.alphaBound << " allowed), ";
+    if (mse > 0)
+        std::cout << 10 * log10(255.0 * 255.0 / mse) << " dB\n";
+    else
+        std::cout << "exact\n";
+
+    return colorError <= test.colorBound && alphaError <= test.alphaBound;
+}
+
+static bool readFile(const std::string& path, std::string& bytes)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    bytes = contents.str();
+    return in.good() || in.eof();
+}
+
+static void writeFile(const std::string& path, const std::string& bytes)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+// the cache written for a stand in image file has to come back the same, and broken ones must be refused
+static bool checkCache(const TestImage& test, const CompressedImage& compressed, bool verbose)
+{
+    std::string imagePath = (std::filesystem::temp_directory_path() / (std::string("texcheck-") + test.name + ".png")).string();
+    std::string cachePath = TextureCache::pathFor(imagePath.c_str());
+    writeFile(imagePath, "stands in for an image file, the cache only looks at its size and time");
+
+    bool ok = true;
+    auto fail = [&](const char* what) {
+        std::cout << "  cache : " << what << "\n";
+        ok = false;
+    };
+
+    // the cache's own complaints go to std::cout, they are only noise here unless asked for
+    std::streambuf* console = std::cout.rdbuf();
+    std::stringstream quiet;
+    auto load = [&](CompressedImage& loaded) {
+        if (!verbose) std::cout.rdbuf(quiet.rdbuf());
+        bool good = TextureCache::load(imagePath.c_str(), loaded);
+        std::cout.rdbuf(console);
+        return good;
+    };
+
+    CompressedImage loaded;
+    if (!TextureCache::write(imagePath.c_str(), compressed))
+        fail("couldn't write it");
+    else if (!load(loaded))
+        fail("couldn't read it back");
+    else {
+        bool same = loaded.format == compressed.format && loaded.width == compressed.width && loaded.height == compressed.height &&
+            loaded.levels.size() == compressed.levels.size();
+        for (size_t level = 0; same && level < loaded.levels.size(); level++)
+            same = loaded.levelBytes[level] == compressed.levelBytes[level] &&
+                memcmp(loaded.levels[level], compressed.levels[level], loaded.levelBytes[level]) == 0;
+        if (!same)
+            fail("read back different from what was written");
+    }
+    freeCompressed(loaded);
+
+    std::string good;
+    if (ok && readFile(cachePath, good)) {
+        TextureCacheHeader header;
+        memcpy(&header, good.data() + 12, sizeof(header));
+        size_t firstLevel = 12 + sizeof(header) + header.bytesOfKeyValueData;
+
+        // each of these is one thing wrong with the good file, and must not load
+        struct Damage {
+            const char* what;
+            std::function<void(std::string&)> apply;
+        };
+        std::vector<Damage> damages = {
+            { "cut short by a byte", [](std::string& bytes) { bytes.pop_back(); } },
+            { "cut short in the middle of level 0", [&](std::string& bytes) { bytes.resize(firstLevel + 4 + compressed.levelBytes[0] / 2); } },
+            { "level 0 a block too big", [&](std::string& bytes) {
+                unsigned size = (unsigned)compressed.levelBytes[0] + (compressed.format == TEXTURE_FORMAT_BC1 ? 8 : 16);
+                memcpy(&bytes[firstLevel], &size, sizeof(size));
+            } },
+            { "level 0 a block too small", [&](std::string& bytes) {
+                unsigned size = (unsigned)compressed.levelBytes[0] - (compressed.format == TEXTURE_FORMAT_BC1 ? 8 : 16);
+                memcpy(&bytes[firstLevel], &size, sizeof(size));
+            } },
+            { "missing a mipmap", [](std::string& bytes) {
+                unsigned levels;
+                memcpy(&levels, &bytes[12 + offsetof(TextureCacheHeader, numberOfMipmapLevels)], sizeof(levels));
+                levels--;
+                memcpy(&bytes[12 + offsetof(TextureCacheHeader, numberOfMipmapLevels)], &levels, sizeof(levels));
+            } },
+            { "not a KTX file", [](std::string& bytes) { bytes[1] = 'X'; } },
+        };
+
+        for (const Damage& damage : damages) {
+            std::string bytes = good;
+            damage.apply(bytes);
+            writeFile(cachePath, bytes);
+            if (load(loaded))
+                fail((std::string("loaded one ") + damage.what).c_str());
+            freeCompressed(loaded);
+        }
+
+        // and a good cache for an image that has since changed
+        writeFile(cachePath, good);
+        writeFile(imagePath, "a different image file, a different size");
+        if (load(loaded))
+            fail("loaded one older than its image");
+        freeCompressed(loaded);
+    }
+
+    std::error_code error;
+    std::filesystem::remove(imagePath, error);
+    std::filesystem::remove(cachePath, error);
+
+    if (ok)
+        std::cout << "  cache : round trip and damaged files ok\n";
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = argc > 1 && std::string(argv[1]) == "-v";
+
+    std::vector<TestImage> tests = {
+        { "solid-rgb", 32, 32, 3, TEXTURE_FORMAT_BC1, 4, 0, [](int, int, unsigned char* p) { p[0] = 200; p[1] = 101; p[2] = 47; } },
+        { "solid-rgba", 13, 7, 4, TEXTURE_FORMAT_BC3, 4, 0, [](int, int, unsigned char* p) { p[0] = 30; p[1] = 160; p[2] = 221; p[3] = 128; } },
+        { "solid-grey", 5, 5, 1, TEXTURE_FORMAT_BC1, 4, 0, [](int, int, unsigned char* p) { p[0] = 99; } },
+        { "solid-grey-alpha", 9, 9, 2, TEXTURE_FORMAT_BC5, 0, 0, [](int, int, unsigned char* p) { p[0] = 77; p[1] = 200; } },
+        { "opaque-rgba", 16, 16, 4, TEXTURE_FORMAT_BC1, 4, 0, [](int, int, unsigned char* p) { p[0] = 10; p[1] = 20; p[2] = 30; p[3] = 255; } },
+        { "gradient-rgb", 64, 64, 3, TEXTURE_FORMAT_BC1, 12, 0, [](int x, int y, unsigned char* p) {
+            p[0] = (unsigned char)(x * 4); p[1] = (unsigned char)(y * 4); p[2] = (unsigned char)(255 - (x + y) * 2); } },
+        { "gradient-grey", 37, 23, 1, TEXTURE_FORMAT_BC1, 8, 0, [](int x, int, unsigned char* p) { p[0] = (unsigned char)(x * 7); } },
+        { "gradient-grey-alpha", 64, 30, 2, TEXTURE_FORMAT_BC5, 2, 2, [](int x, int y, unsigned char* p) {
+            p[0] = (unsigned char)(x * 4); p[1] = (unsigned char)(y * 8); } },
+        { "gradient-alpha", 21, 40, 4, TEXTURE_FORMAT_BC3, 4, 2, [](int, int y, unsigned char* p) {
+            p[0] = 250; p[1] = 128; p[2] = 0; p[3] = (unsigned char)(y * 6); } },
+        // the edge falls inside a block, which then has only 0 and 255 and has to keep them exactly
+        { "alpha-edge", 30, 18, 4, TEXTURE_FORMAT_BC3, 4, 0, [](int x, int, unsigned char* p) {
+            p[0] = 60; p[1] = 180; p[2] = 90; p[3] = x < 11 ? 255 : 0; } },
+        { "alpha-edge-grey", 19, 6, 2, TEXTURE_FORMAT_BC5, 0, 0, [](int x, int y, unsigned char* p) {
+            p[0] = 140; p[1] = x + y < 9 ? 0 : 255; } },
+    };
+
+    unsigned failed = 0;
+    for (const TestImage& test : tests) {
+        std::cout << test.name << " (" << test.width << " x " << test.height << ", " << test.channels << " channels)\n";
+
+        DecodedImage image;
+        std::vector<unsigned char> pixels;
+        makeImage(test, image, pixels);
+
+        CompressedImage compressed;
+        bool ok = checkEncoder(test, image, compressed);
+        if (compressed.format != 0)
+            ok = checkCache(test, compressed, verbose) && ok;
+        freeCompressed(compressed);
+
+        if (!ok) {
+            std::cout << "  FAILED\n";
+            failed++;
+        }
+    }
+
+    std::cout << tests.size() - failed << " of " << tests.size() << " images ok\n";
+    return failed ? 1 : 0;
+}
@@ -21,12 +21,17 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <cstdio>
 #include <vector>
 #include <map>
 #include <filesystem>
 
 #include "shader_s.h"
 #include "ImportedModel.h"
+#include "AssetLoader.h"
+#include "TextureResidency.h"
+#include "VertexPacking.h"
+#include "textures.h"
 
 #include "renderer.h"
 #include "SceneGraph.h"
@@ -40,6 +45,7 @@ extern glm::mat4 vMat; // view matrix
 extern unsigned int texture[];
 extern unsigned int textureColorbuffer;
 extern unsigned int depthMap;
+extern double sceneSubmitMilliseconds;
 
 static int item_current_idx = 0; // Here we store our selection data as an index.
 
@@ -69,6 +75,27 @@ void drawIMGUI(Renderer *myRenderer, iCubeModel*cubeSystem,
             ImGui::Begin("Graphics For Games V3");  // Create a window and append into it.
 
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+            ImGui::Text("scene submit %.3f ms/frame on the CPU", sceneSubmitMilliseconds);
+
+            if (unsigned loading = pendingAssets())
+                ImGui::Text("loading %u assets in the background", loading);
+
+            ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.0f, 8.0f);
+            // only the models added afterwards (the Model Editor's buttons, dropped files) are packed
+            ImGui::Checkbox("pack vertices of new models", &packVertices);
+
+            // texture memory against the budget, the bar fills up to it
+            TextureResidencyStats residency = textureResidency();
+            float textureMB = residency.bytes / (1024.0f * 1024.0f);
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%.1f MB of %d MB", textureMB, textureBudgetMB);
+            ImGui::ProgressBar(textureBudgetMB > 0 ? textureMB / textureBudgetMB : 0.0f, ImVec2(0.0f, 0.0f), overlay);
+            ImGui::SameLine(); ImGui::Text("textures");
+            ImGui::Text("%u textures, %u cut down (%.1f MB at full size), %u coming back", residency.textures, residency.reduced,
+                residency.fullBytes / (1024.0f * 1024.0f), residency.restoring);
+            ImGui::SliderInt("texture budget MB", &textureBudgetMB, 0, 4096);
+            // lossy, and only for the textures loaded afterwards
+            ImGui::Checkbox("block compress new textures", &compressTextures);
 
             static float tFloat = 0.0;
             ImGui::SliderFloat("timeOffset", &tFloat, -5.0f, 5.0f);
@@ -201,6 +228,7 @@ void ListRenderers(SceneGraph *sg, treeNode* nodes[])
                 strcpy(cName, Renderer::renderList[item_current_idx]->name.c_str());
                 ImGui::InputText("##edit", cName, IM_ARRAYSIZE(cName));
                 Renderer::renderList[item_current_idx]->name = cName;
+                ImGui::SameLine(); ImGui::Text(Renderer::renderList[item_current_idx]->packed ? "packed" : "floats");
 
                 ImGui::Separator();
                 if (ImGui::BeginTabBar("##Tabs", ImGuiTabBarFlags_None))
@@ -297,6 +325,13 @@ void ListRenderers(SceneGraph *sg, treeNode* nodes[])
                             sg->purgeRenderer(Renderer::renderList[i]);
                     }
                 }
+                // replaces whatever the rayTrace texture was showing with this model, path traced from the camera
+                ObjModel* obj = dynamic_cast<ObjModel*>(Renderer::renderList[item_current_idx]);
+                if (obj != NULL && obj->ready) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Ray Trace"))
+                        obj->rayTrace(sg->camera.position, sg->camera.target, glm::degrees(sg->camera.getFOV()));
+                }
             }
             if (ImGui::Button("Add Torus")) {
                 sg->getRoot()->addRenderer(new TorusModel(Material::materials["litMaterial"], glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f))));
@@ -365,7 +400,7 @@ void ShaderEditor(SceneGraph* sg) {
                     ImGui::PushID(i);
 
                     if (ImGui::ImageButton((void*)(intptr_t)texture[i], ImVec2(64, 64)))
-                        Material::materials["checkers"]->textures[0] = texture[i];
+                        Material::materials["checkers"]->setTexture(0, texture[i]);
                     ImGui::PopID();
                     ImGui::SameLine();
                 }
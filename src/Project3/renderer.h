@@ -5,8 +5,11 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 
+#include <memory>
+
 #include "SceneGraph.h"
 #include "Material.h"
+#include "ImportedModel.h"
 
 struct SceneGraph;
 
@@ -32,15 +35,25 @@ public :
 
     Material* myMaterial = NULL;
 
+    bool packed = false;        /// the vertices are PackedVertex (see VertexPacking.h) and the shaders decode them
+    glm::vec3 packedMin = glm::vec3(0.0f), packedExtent = glm::vec3(1.0f);    /// the box packed positions are fractions of
+
 protected:
     void setupColorAttrib();
+    // fills the bound GL_ARRAY_BUFFER with count vertices of floatsPerVertex floats, position first, and points
+    // attributes 0, 1 and 3 at the position, normal and texture coordinate, packed first when packVertices is set
+    void uploadVertices(const float* vertices, unsigned int floatsPerVertex, unsigned int count, unsigned int normalOffset, unsigned int texCoordOffset);
+    // attributes 0, 1 and 3 for a bound buffer of PackedVertex
+    void setupPackedAttribs();
+    // tells shader whether (and how) to decode this model's vertices, every draw sets it since shaders are shared
+    void setPackingUniforms(Shader* shader);
 
 public:
     Renderer(){
         name = "name" + std::to_string(renderList.size());
         renderList.push_back(this);
     }
-    ~Renderer() {
+    virtual ~Renderer() {
         glDeleteBuffers(numVBOs, VBO);
         glDeleteBuffers(1, &EBO);
         glDeleteVertexArrays(1, &VAO);
@@ -116,16 +129,38 @@ public:
 
 };
 
-struct objMesh {
-    std::string myName;
-    int startingVert;
-};
+struct ObjModelData;
+
+// how many pixels a level of detail may be off on screen before ObjModel goes back to a finer one, 0 keeps every model at full detail
+extern float lodPixelError;
+// a level of detail is only swapped for a coarser one once its error is this fraction under lodPixelError
+#define LOD_HYSTERESIS 0.25f
 
 class ObjModel : public Renderer {
 public:
     std::vector<objMesh> meshes;
-    ObjModel(const char* filePath, Material*, glm::mat4 m);
+    std::vector<objLOD> lods;   /// the full mesh first, see MeshSimplifier.h
+    unsigned int lod = 0;       /// the one drawn last
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    unsigned int indexSize = sizeof(unsigned int);    /// bytes per index in the EBO, 2 when every vertex number fits in 16 bits
+    bool ready = true;          /// false while a background load is going, a placeholder is drawn until then
+    std::string filePath;       /// the OBJ, name may be edited
+    // with background set this returns right away and the model is read and uploaded by the asset loader (AssetLoader.h)
+    ObjModel(const char* filePath, Material*, glm::mat4 m, bool background = false);
+    ~ObjModel();
     void render(glm::mat4 vMat, glm::mat4 pMat, double deltaTime, SceneGraph* sg);
+    unsigned int indexType();   /// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT to match indexSize
+    unsigned int selectLOD(glm::mat4 vMat, SceneGraph* sg);
+    // path traces the full mesh into the progressive rayTrace texture, from eye looking at target with a vertical
+    // fov in degrees, the ray scene is built on the asset loader's thread from the .g4gmesh cache the load wrote
+    void rayTrace(glm::vec3 eye, glm::vec3 target, float fov);
+
+private:
+    std::shared_ptr<ObjModelData> loading;
+    void setupVertexAttribs(ObjModelData& data);
+    bool uploadSlice();
+    void renderPlaceholder(glm::mat4 vMat, glm::mat4 pMat, double deltaTime, SceneGraph* sg);
 };
 
 class TorusModel : public Renderer {
@@ -12,10 +12,12 @@
 #include <cmath>
 #include <vector>
 #include <filesystem>
+#include <cstddef>
 
 #include "renderer.h"
 #include "ImportedModel.h"
 #include "SceneGraph.h"
+#include "VertexPacking.h"
 
 std::map<std::string, Material*> Material::materials;
 std::map<std::string, Shader*> Shader::shaders;
@@ -36,7 +38,7 @@ void Renderer::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
     * */
 
     glm::mat4 mvp;
-    unsigned int shaderID;
+    Shader* shader;
 
     if (!enabled) return;
 
@@ -48,24 +50,26 @@ void Renderer::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
     glm::vec3 lightLoc = sg->light.position;
     glm::vec3 cameraLoc = sg->camera.position;
 
-    shaderID =  myMaterial->use(sg->renderPass);
+    shader = myMaterial->use(sg->renderPass);
 
-    glUniform1f(glGetUniformLocation(shaderID, "myTime"), elapsedTime += (float)deltaTime);
+    shader->setFloat(Uniform::myTime, elapsedTime += (float)deltaTime);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "m"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "v"), 1, GL_FALSE, glm::value_ptr(treeMat));
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "p"), 1, GL_FALSE, glm::value_ptr(vpMat));
+    shader->setMat4(Uniform::m, modelMatrix);
+    shader->setMat4(Uniform::v, treeMat);
+    shader->setMat4(Uniform::p, vpMat);
 
     // because it is only once per model, another approach might be just to pre-multiply model, view and perspective 
     mvp = vpMat * treeMat * modelMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
+    shader->setMat4(Uniform::mvp, mvp);
 
-    glUniform3fv(glGetUniformLocation(shaderID, "cPos"), 1, glm::value_ptr(cameraLoc));
-    glUniform3fv(glGetUniformLocation(shaderID, "lPos"), 1, glm::value_ptr(lightLoc));
+    shader->setVec3(Uniform::cPos, cameraLoc);
+    shader->setVec3(Uniform::lPos, lightLoc);
 
     glm::mat4 lightViewProjection = sg->light.projection() * glm::lookAt(sg->light.position, sg->light.target, sg->light.up);
     
-    glUniformMatrix4fv(glGetUniformLocation(shaderID,"lightSpaceMatrix"),1,GL_FALSE,glm::value_ptr(lightViewProjection));
+    shader->setMat4(Uniform::lightSpaceMatrix, lightViewProjection);
+
+    setPackingUniforms(shader);
     
     glBindVertexArray(VAO);
 
@@ -75,12 +79,66 @@ void Renderer::render(glm::mat4 treeMat, glm::mat4 vpMat, double deltaTime, Scen
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    if (instances > 0)
+        myMaterial->drawn(shader);
+
     if (indexCount < 0) 
         glDrawArraysInstanced(GL_TRIANGLES, 0, -indexCount, instances);
     else
         glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instances);
 }
 
+void Renderer::uploadVertices(const float* vertices, unsigned int floatsPerVertex, unsigned int count, unsigned int normalOffset, unsigned int texCoordOffset)
+{
+    if (packVertices) {
+        std::vector<PackedVertex> packedVertices;
+        packVertexData(vertices, floatsPerVertex, count, normalOffset, texCoordOffset, packedVertices, packedMin, packedExtent);
+        glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+        setupPackedAttribs();
+        return;
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, (size_t)count * floatsPerVertex * sizeof(float), vertices, GL_STATIC_DRAW);
+
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // normal vector attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)(normalOffset * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    // texture coord attribute
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)(texCoordOffset * sizeof(float)));
+    glEnableVertexAttribArray(3);
+}
+
+void Renderer::setupPackedAttribs()
+{
+    packed = true;
+
+    // position, fractions of the bounding box
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+
+    // octahedral normal, the shaders unfold it
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    // texture coord, half floats
+    glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoord));
+    glEnableVertexAttribArray(3);
+}
+
+void Renderer::setPackingUniforms(Shader* shader)
+{
+    shader->setInt(Uniform::packed, packed);
+    if (packed) {
+        shader->setVec3(Uniform::packedMin, packedMin);
+        shader->setVec3(Uniform::packedExtent, packedExtent);
+    }
+}
+
 void Renderer::setupColorAttrib() {
     // color attribute
 
@@ -3,11 +3,34 @@
 
 #include <glad/glad.h>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+// a uniform's name hashed with 32 bit FNV-1a, the setters take these instead of names so a draw never has the
+// driver look a string up, constexpr so the ones in Uniform below are hashed by the compiler
+constexpr unsigned int uniformID(const char* name, unsigned int hash = 2166136261u)
+{
+    return *name ? uniformID(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+// the uniforms the renderers and materials set on every draw
+struct Uniform {
+    static constexpr unsigned int m = uniformID("m"), v = uniformID("v"), p = uniformID("p"), mvp = uniformID("mvp");
+    static constexpr unsigned int cPos = uniformID("cPos"), lPos = uniformID("lPos"), lightSpaceMatrix = uniformID("lightSpaceMatrix");
+    static constexpr unsigned int myTime = uniformID("myTime"), shine = uniformID("shine"), ourColor = uniformID("ourColor");
+    static constexpr unsigned int OurTexture = uniformID("OurTexture"), shadowMap = uniformID("shadowMap"), EnvTexture = uniformID("EnvTexture");
+    static constexpr unsigned int skybox = uniformID("skybox");
+    static constexpr unsigned int packed = uniformID("packed"), packedMin = uniformID("packedMin"), packedExtent = uniformID("packedExtent");
+};
 
 class Shader
 {
@@ -19,6 +42,9 @@ public:
 
     static std::map<std::string, Shader*> shaders;
 
+    // every active uniform's uniformID() and location, sorted, read from the program after each link
+    std::vector<std::pair<unsigned int, int>> uniforms;
+
 public:
     char vtext[2048], ftext[4192];
 
@@ -101,6 +127,8 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        reflectUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -108,21 +136,39 @@ public:
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // where the uniform is, -1 (which GL ignores) when the program hasn't got it
+    int location(unsigned int id) const
+    {
+        auto found = std::lower_bound(uniforms.begin(), uniforms.end(), std::make_pair(id, INT_MIN));
+        return found != uniforms.end() && found->first == id ? found->second : -1;
+    }
+    // the same by name, an array element ("lights[2]") or struct member isn't in the table, GL is asked for those
+    int location(const std::string& name) const
+    {
+        int where = location(uniformID(name.c_str()));
+        return where >= 0 ? where : glGetUniformLocation(ID, name.c_str());
+    }
+    // utility uniform functions, by uniformID() (see Uniform) or by name
+    // ------------------------------------------------------------------------
+    void setInt(unsigned int id, int value) const { glUniform1i(location(id), value); }
+    void setFloat(unsigned int id, float value) const { glUniform1f(location(id), value); }
+    void setVec3(unsigned int id, const glm::vec3& value) const { glUniform3fv(location(id), 1, glm::value_ptr(value)); }
+    void setVec4(unsigned int id, const glm::vec4& value) const { glUniform4fv(location(id), 1, glm::value_ptr(value)); }
+    void setMat4(unsigned int id, const glm::mat4& value) const { glUniformMatrix4fv(location(id), 1, GL_FALSE, glm::value_ptr(value)); }
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     void saveShaders() {
         std::ofstream myfile;
@@ -137,6 +183,37 @@ public:
     }
 
 private:
+    // fills uniforms from the program's active uniforms
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        int count = 0, longest = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+        std::vector<char> buffer(std::max(longest, 1));
+        std::map<unsigned int, std::string> names;
+
+        for (int i = 0; i < count; i++) {
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string uniform(buffer.data(), length);
+            // an array is listed as name[0], it is set by its plain name, and uniform blocks have no location
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+                uniform.resize(uniform.size() - 3);
+            int where = glGetUniformLocation(ID, uniform.c_str());
+            if (where < 0)
+                continue;
+
+            unsigned int id = uniformID(uniform.c_str());
+            if (names.count(id))
+                std::cout << name << " : uniforms " << names[id] << " and " << uniform << " hash the same, rename one\n";
+            names[id] = uniform;
+            uniforms.push_back({ id, where });
+        }
+        std::sort(uniforms.begin(), uniforms.end());
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
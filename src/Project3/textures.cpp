@@ -16,6 +16,12 @@
 #include <cmath>
 #include <vector>
 #include <filesystem>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <system_error>
 
 #include "shader_s.h"
 #include "ImportedModel.h"
@@ -24,6 +30,11 @@
 #include "renderer.h"
 
 #include "textures.h"
+#include "TextureCache.h"
+#include "TextureResidency.h"
+#include "AssetLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -32,48 +43,337 @@
 extern unsigned char imageBuff[512][512][4];
 
 int myTexture();
-int RayTracer();
-
-// loads a cubemap texture from 6 individual texture faces
-// order:
-// +X (right)
-// -X (left)
-// +Y (top)
-// -Y (bottom)
-// +Z (front) 
-// -Z (back)
-// -------------------------------------------------------
-unsigned int loadCubemap(std::vector<std::string> faces)
+int RayTracer(unsigned char* rgba, unsigned width, unsigned height, unsigned threads = 0);
+
+struct RayScene;
+void startProgressiveRayTracer(unsigned width, unsigned height, unsigned threads, RayScene* scene);
+void showInProgressiveRayTracer(RayScene* scene);
+unsigned progressiveRayTracerPasses();
+unsigned resolveProgressiveRayTracer(unsigned char* rgba);
+void stopProgressiveRayTracer();
+
+// threads used by the ray traced texture, 0 uses every core and 1 traces on this thread
+unsigned rayTraceThreads = 0;
+
+// when set the ray traced texture is path traced on a background thread and refines every frame
+// instead of being traced once (Whitted style) before the first frame, showInRayTraceTexture() turns it on later
+bool rayTraceProgressive = false;
+
+// the progressive image goes through a pair of pixel buffers, one is filled while the
+// other one is being copied into the texture, so the upload doesn't stall the frame
+static unsigned int rayTracePBO[2] = { 0, 0 };
+static unsigned int rayTracePBOPasses[2] = { 0, 0 };   // number of the image each buffer holds, 0 when empty
+static unsigned int rayTracePBOIndex = 0;
+static unsigned int rayTraceUploaded = 0;               // number of the image in the texture
+
+// when set loadTextures() uploads block compressed mip chains, from the .g4gtex next to the image when there
+// is one that's up to date, otherwise the pixels go up and the loader thread encodes the cache for next time
+// (see TextureCache.h), off by default since the blocks are lossy, the sandbox window has a checkbox for it
+bool compressTextures = false;
+
+// see textures.h, the texture loads' counterpart of importerVerbose
+bool texturesVerbose = false;
+
+// one image on its way into a texture, target is GL_TEXTURE_2D or one of a cube map's faces
+// the blocks are uploaded when compressed has any, the pixels otherwise
+struct PendingUpload {
+    unsigned int texture, target;
+    DecodedImage* image;
+    CompressedImage* compressed;
+    size_t offset;
+};
+
+// as many bytes a texel as the image has channels, so GL never reads past a grey or grey and alpha image
+static unsigned int imageFormat(const DecodedImage& image)
 {
-    unsigned int tNum;
-    glGenTextures(1, &tNum);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, tNum);
+    return image.channels == 4 ? GL_RGBA : image.channels == 3 ? GL_RGB : image.channels == 2 ? GL_RG : GL_RED;
+}
 
-    int width, height, nrComponents;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+// a grey image (1 channel) is sampled as R R R 1 and grey and alpha (2 channels, or their BC5 blocks) as R R R G,
+// so the shaders see them the same as an RGB or RGBA image
+static void swizzleGrey(unsigned int target, int channels)
+{
+    if (channels != 1 && channels != 2)
+        return;
+    int swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+static size_t imageBytes(const DecodedImage& image)
+{
+    size_t bytes = (size_t)image.width * image.height * image.channels;
+    for (const std::vector<unsigned char>& level : image.mipmaps)
+        bytes += level.size();
+    return bytes;
+}
+
+static size_t uploadBytes(const PendingUpload& upload)
+{
+    if (upload.compressed == NULL || upload.compressed->levels.empty())
+        return imageBytes(*upload.image);
+
+    size_t bytes = 0;
+    for (size_t level : upload.compressed->levelBytes)
+        bytes += level;
+    return bytes;
+}
+
+// the block formats need GL_EXT_texture_compression_s3tc, which every desktop driver has, RGTC is core since 3.0
+static bool compressedTexturesSupported()
+{
+    static int supported = -1;
+    if (supported < 0) {
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        supported = 0;
+        for (int i = 0; i < count && !supported; i++)
+            supported = strcmp((const char*)glGetStringi(GL_EXTENSIONS, (unsigned)i), "GL_EXT_texture_compression_s3tc") == 0;
+        if (!supported)
+            std::cout << "no S3TC texture compression, textures are uploaded as they are\n";
+    }
+    return supported == 1;
+}
+
+// every level of every image through one pixel buffer : the copies into it run across the shared pool and the
+// driver moves it to the textures without stalling, the textures must have their parameters set already
+static void uploadThroughPixelBuffer(std::vector<PendingUpload>& uploads)
+{
+    size_t total = 0;
+    for (PendingUpload& upload : uploads) {
+        upload.offset = total;
+        total += (uploadBytes(upload) + 3) & ~(size_t)3;
+    }
+    if (total == 0)
+        return;
+
+    unsigned int pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+    unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (mapped) {
+        ThreadPool::shared().parallelFor((unsigned)uploads.size(), [&](unsigned i) {
+            const DecodedImage& image = *uploads[i].image;
+            unsigned char* out = mapped + uploads[i].offset;
+            if (uploads[i].compressed && !uploads[i].compressed->levels.empty()) {
+                const CompressedImage& blocks = *uploads[i].compressed;
+                for (size_t level = 0; level < blocks.levels.size(); level++) {
+                    memcpy(out, blocks.levels[level], blocks.levelBytes[level]);
+                    out += blocks.levelBytes[level];
+                }
+                return;
+            }
+            if (image.pixels == NULL)
+                return;
+            size_t bytes = (size_t)image.width * image.height * image.channels;
+            memcpy(out, image.pixels, bytes);
+            out += bytes;
+            for (const std::vector<unsigned char>& level : image.mipmaps) {
+                memcpy(out, level.data(), level.size());
+                out += level.size();
+            }
+        });
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else {
+        // no buffer to be had, straight from memory then
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // rows of an RGB, RG or grey level needn't start on 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const PendingUpload& upload : uploads) {
+        const DecodedImage& image = *upload.image;
+        glBindTexture(upload.target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP, upload.texture);
+        size_t offset = upload.offset;
+
+        if (upload.compressed && !upload.compressed->levels.empty()) {
+            const CompressedImage& blocks = *upload.compressed;
+            int width = blocks.width, height = blocks.height;
+            for (size_t level = 0; level < blocks.levels.size(); level++) {
+                glCompressedTexImage2D(upload.target, (int)level, blocks.format, width, height, 0, (int)blocks.levelBytes[level],
+                    mapped ? (const void*)offset : (const void*)blocks.levels[level]);
+                offset += blocks.levelBytes[level];
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+            }
+            continue;
         }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
+        if (image.pixels == NULL)
+            continue;
+
+        int width = image.width, height = image.height;
+        for (size_t level = 0; level <= image.mipmaps.size(); level++) {
+            const unsigned char* pixels = level == 0 ? image.pixels : image.mipmaps[level - 1].data();
+            glTexImage2D(upload.target, (int)level, imageFormat(image), width, height, 0, imageFormat(image), GL_UNSIGNED_BYTE,
+                mapped ? (const void*)offset : (const void*)pixels);
+            offset += (size_t)width * height * image.channels;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
         }
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);   // GL keeps it until the uploads are done with it
+}
+
+// decodes every file and builds its mip chain, spread over the shared pool
+static void decodeImages(const std::string* paths, unsigned int count, std::vector<DecodedImage>& images, bool flip)
+{
+    images.resize(count);
+    ThreadPool::shared().parallelFor(count, [&](unsigned i) {
+        if (decodeImage(paths[i].c_str(), images[i], flip))
+            buildMipmaps(images[i]);
+    });
+}
+
+unsigned int loadCubemap(std::vector<std::string> faces)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<DecodedImage> images;
+    decodeImages(faces.data(), (unsigned int)faces.size(), images, false);
+
+    unsigned int tNum;
+    glGenTextures(1, &tNum);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tNum);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    swizzleGrey(GL_TEXTURE_CUBE_MAP, images[0].channels);
+
+    std::vector<PendingUpload> uploads;
+    for (unsigned int i = 0; i < images.size(); i++) {
+        if (images[i].pixels == NULL)
+            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+        uploads.push_back({ tNum, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, &images[i], NULL, 0 });
+    }
+    uploadThroughPixelBuffer(uploads);
+    trackTexture(tNum, GL_TEXTURE_CUBE_MAP);
+
+    for (DecodedImage& image : images)
+        freeImage(image);
 
+    if (texturesVerbose)
+        std::cout << "loaded cubemap " << faces[0] << " and " << faces.size() - 1 << " more faces in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * 1000 << " ms\n";
     return tNum;
 }
 
+bool textureCompressionEnabled()
+{
+    return compressTextures && compressedTexturesSupported();
+}
+
+void readTextureImages(const std::string* paths, unsigned int count, bool compress, DecodedImage* images, CompressedImage* compressed,
+    unsigned int& fromCache, unsigned int& encoded, bool encode)
+{
+    // an up to date cache is mapped instead of decoding the image at all
+    ThreadPool::shared().parallelFor(count, [&](unsigned i) {
+        if (compress && TextureCache::load(paths[i].c_str(), compressed[i]))
+            return;
+        if (decodeImage(paths[i].c_str(), images[i], true))
+            buildMipmaps(images[i]);
+    });
+
+    // the rest are encoded one after the other, each spread over the pool, and kept for next time
+    fromCache = encoded = 0;
+    for (unsigned int i = 0; i < count && compress; i++) {
+        if (!compressed[i].levels.empty()) {
+            fromCache++;
+            continue;
+        }
+        if (!encode || !compressImage(images[i], compressed[i]))
+            continue;
+        freeImage(images[i]);
+        encoded++;
+        if (!TextureCache::write(paths[i].c_str(), compressed[i]))
+            std::cout << "couldn't write " << TextureCache::pathFor(paths[i].c_str()) << ", the next launch encodes " << paths[i] << " again\n";
+    }
+}
+
+// an image loadTextures() had no cache for goes up as pixels, the loader thread then block compresses it and writes
+// the cache for next time, so the encode never holds up the render thread, image is left empty
+static void cacheInBackground(const std::string& path, DecodedImage& image)
+{
+    std::shared_ptr<DecodedImage> kept(new DecodedImage(std::move(image)), [](DecodedImage* image) {
+        freeImage(*image);
+        delete image;
+        });
+    image.pixels = NULL;
+
+    loadInBackground(
+        [kept, path]() {
+            CompressedImage compressed;
+            if (compressImage(*kept, compressed) && !TextureCache::write(path.c_str(), compressed))
+                std::cout << "couldn't write " << TextureCache::pathFor(path.c_str()) << ", the next launch encodes " << path << " again\n";
+            freeCompressed(compressed);
+            freeImage(*kept);
+        },
+        []() { return true; });
+}
+
+void loadTextures(const std::string* paths, unsigned int count, unsigned int* textures)
+{
+    if (count == 0)
+        return;
+    auto startTime = std::chrono::steady_clock::now();
+
+    bool compress = textureCompressionEnabled();
+    std::vector<DecodedImage> images(count);
+    std::vector<CompressedImage> compressed(count);
+    unsigned int fromCache, encoded;
+    readTextureImages(paths, count, compress, images.data(), compressed.data(), fromCache, encoded, false);
+
+    glGenTextures((int)count, textures);
+
+    // in batches of about TEXTURE_UPLOAD_BATCH bytes, so a big model doesn't need one huge buffer
+    std::vector<PendingUpload> uploads;
+    size_t batchBytes = 0, totalBytes = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        // the same parameters as setupTexture()
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // BC5 has the grey in red and the alpha in green, BC1 holds grey as RGB
+        if (compressed[i].levels.empty())
+            swizzleGrey(GL_TEXTURE_2D, images[i].channels);
+        else if (compressed[i].format == TEXTURE_FORMAT_BC5)
+            swizzleGrey(GL_TEXTURE_2D, 2);
+
+        uploads.push_back({ textures[i], GL_TEXTURE_2D, &images[i], &compressed[i], 0 });
+        batchBytes += uploadBytes(uploads.back());
+        totalBytes += uploadBytes(uploads.back());
+
+        if (batchBytes >= TEXTURE_UPLOAD_BATCH || i + 1 == count) {
+            uploadThroughPixelBuffer(uploads);
+            for (const PendingUpload& upload : uploads) {
+                if (compress && upload.compressed->levels.empty() && upload.image->pixels)
+                    cacheInBackground(paths[upload.image - images.data()], *upload.image);
+                freeImage(*upload.image);
+                freeCompressed(*upload.compressed);
+            }
+            uploads.clear();
+            batchBytes = 0;
+        }
+    }
+    for (unsigned int i = 0; i < count; i++)
+        trackTexture(textures[i], GL_TEXTURE_2D, paths[i].c_str());
+
+    if (!texturesVerbose)
+        return;
+    if (compress)
+        std::cout << fromCache << " of " << count << (count == 1 ? " texture" : " textures") << " from caches, the rest are block compressed in the background\n";
+    std::cout << "loaded " << count << (count == 1 ? " texture (" : " textures (") << totalBytes / 1024 << " KB with mipmaps) on "
+        << ThreadPool::shared().size() << " threads in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * 1000 << " ms\n";
+}
+
 void setupTexture(unsigned int tNum, const void* buff, int x, int y, unsigned int fmt)
 {
     glBindTexture(GL_TEXTURE_2D, tNum); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
@@ -89,11 +389,76 @@ void setupTexture(unsigned int tNum, const void* buff, int x, int y, unsigned in
     glTexImage2D(GL_TEXTURE_2D, 0, fmt, x, y, 0, fmt, GL_UNSIGNED_BYTE, buff);
     glGenerateMipmap(GL_TEXTURE_2D);
 
+    trackTexture(tNum, GL_TEXTURE_2D);
+}
+// the pixel buffers and the progressive tracer behind them, updateTextures() moves its passes into texture[1]
+// scene NULL traces the demo spheres
+static void startRayTraceStream(RayScene* scene)
+{
+    glGenBuffers(2, rayTracePBO);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, rayTracePBO[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, 512 * 512 * 4, NULL, GL_STREAM_DRAW);
+        rayTracePBOPasses[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    rayTracePBOIndex = rayTraceUploaded = 0;
+
+    startProgressiveRayTracer(512, 512, rayTraceThreads, scene);
+}
+
+void showInRayTraceTexture(RayScene* scene)
+{
+    if (rayTracePBO[0])
+        showInProgressiveRayTracer(scene);
+    else
+        startRayTraceStream(scene);
 }
+
 void deleteTextures(unsigned int texture[])
 {
+    if (rayTracePBO[0]) {
+        stopProgressiveRayTracer();
+        glDeleteBuffers(2, rayTracePBO);
+        rayTracePBO[0] = rayTracePBO[1] = 0;
+    }
+    for (int i = 0; i < 3; i++)
+        untrackTexture(texture[i]);
     glDeleteTextures(3, texture);
 }
+
+// call once a frame, moves the newest progressive ray trace into texture[1]
+void updateTextures(unsigned int texture[])
+{
+    // and keep every texture under the budget
+    updateTextureResidency();
+
+    if (!rayTracePBO[0])
+        return;
+
+    // upload whatever was written into the current buffer last frame
+    unsigned int current = rayTracePBOIndex;
+    if (rayTracePBOPasses[current] > rayTraceUploaded) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, rayTracePBO[current]);
+        glBindTexture(GL_TEXTURE_2D, texture[1]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 512, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        rayTraceUploaded = rayTracePBOPasses[current];
+    }
+
+    // and fill the other one if the tracer has finished another pass
+    unsigned int next = current ^ 1;
+    if (progressiveRayTracerPasses() > rayTraceUploaded) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, rayTracePBO[next]);
+        void* pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 512 * 512 * 4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (pixels) {
+            rayTracePBOPasses[next] = resolveProgressiveRayTracer((unsigned char*)pixels);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        rayTracePBOIndex = next;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
 void setupTextures(unsigned int texture[])
 {
     // create textures 
@@ -104,8 +469,16 @@ void setupTextures(unsigned int texture[])
     setupTexture(texture[0], (const void*)imageBuff, 512, 512, GL_RGBA);
     // texture is a buffer we will be generating for pixel experiments
 
-    RayTracer();
-    setupTexture(texture[1], (const void*)imageBuff, 512, 512, GL_RGBA);
+    if (rayTraceProgressive) {
+        // start out black and let updateTextures() fill it in as the passes come in
+        memset(imageBuff, 0, sizeof(imageBuff));
+        setupTexture(texture[1], (const void*)imageBuff, 512, 512, GL_RGBA);
+        startRayTraceStream(NULL);
+    }
+    else {
+        RayTracer(&imageBuff[0][0][0], 512, 512, rayTraceThreads);
+        setupTexture(texture[1], (const void*)imageBuff, 512, 512, GL_RGBA);
+    }
 
     // load textures
 // -------------
@@ -124,22 +497,322 @@ void setupTextures(unsigned int texture[])
 unsigned int loadTexture(const char* fPath)
 {
     unsigned int oneOff;
-    // create textures 
-    // -------------------------
-    glGenTextures(1, &oneOff);
+    std::string path = fPath;
+    loadTextures(&path, 1, &oneOff);
+    return oneOff;
+}
 
-    // load image, create texture and generate mipmaps
-    int width = 0, height = 0, nrChannels = 0;
+bool decodeImage(const char* fPath, DecodedImage& image, bool flip)
+{
+    // the flip is set per thread, so decodes on other threads don't disturb each other
+    stbi_set_flip_vertically_on_load_thread(flip);
+    image.pixels = stbi_load(fPath, &image.width, &image.height, &image.channels, 0);
+    stbi_set_flip_vertically_on_load_thread(false);
 
-    stbi_set_flip_vertically_on_load(true);
+    if (image.pixels == NULL) {
+        std::cout << "couldn't load texture " << fPath << "\n";
+        image.width = image.height = image.channels = 0;
+        return false;
+    }
+    return true;
+}
 
-    unsigned char* data = stbi_load(fPath, &width, &height, &nrChannels, 0);
+void buildMipmaps(DecodedImage& image)
+{
+    image.mipmaps.clear();
 
-    setupTexture(oneOff, (const void*)data, width, height, nrChannels == 4 ? GL_RGBA : GL_RGB);
+    const unsigned char* source = image.pixels;
+    int width = image.width, height = image.height, channels = image.channels;
 
-    stbi_image_free(data);
-    stbi_set_flip_vertically_on_load(false);
-    return oneOff;
+    while (source && (width > 1 || height > 1)) {
+        // an odd last row or column is left out, like most drivers do
+        int levelWidth = std::max(1, width / 2), levelHeight = std::max(1, height / 2);
+        std::vector<unsigned char> level((size_t)levelWidth * levelHeight * channels);
+
+        for (int y = 0; y < levelHeight; y++) {
+            const unsigned char* row0 = source + (size_t)std::min(2 * y, height - 1) * width * channels;
+            const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+            unsigned char* out = &level[(size_t)y * levelWidth * channels];
+
+            for (int x = 0; x < levelWidth; x++) {
+                int x0 = std::min(2 * x, width - 1) * channels, x1 = std::min(2 * x + 1, width - 1) * channels;
+                for (int c = 0; c < channels; c++)
+                    *out++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+
+        image.mipmaps.push_back(std::move(level));
+        source = image.mipmaps.back().data();
+        width = levelWidth;
+        height = levelHeight;
+    }
+}
+
+void freeImage(DecodedImage& image)
+{
+    stbi_image_free(image.pixels);
+    image.pixels = NULL;
+    image.mipmaps.clear();
+    image.mipmaps.shrink_to_fit();
+}
+
+bool uploadImageSlice(unsigned int tNum, const DecodedImage& image, const CompressedImage& compressed, ImageUploadProgress& progress)
+{
+    bool blocks = !compressed.levels.empty();
+    if (!blocks && image.pixels == NULL)
+        return true;
+
+    int levels = blocks ? (int)compressed.levels.size() : (int)image.mipmaps.size() + 1;
+    int width = std::max(1, (blocks ? compressed.width : image.width) >> progress.level);
+    int height = std::max(1, (blocks ? compressed.height : image.height) >> progress.level);
+
+    glBindTexture(GL_TEXTURE_2D, tNum);
+    if (progress.level == 0 && progress.row == 0) {
+        // the same parameters as loadTextures()
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        swizzleGrey(GL_TEXTURE_2D, blocks ? (compressed.format == TEXTURE_FORMAT_BC5 ? 2 : 3) : image.channels);
+    }
+
+    // a row of blocks is 4 rows of texels, the last one may be cut off by the edge
+    int rowHeight = blocks ? 4 : 1;
+    int rowCount = (height + rowHeight - 1) / rowHeight;
+    size_t rowBytes = blocks ? compressedLevelBytes(compressed.format, width, 4) : (size_t)width * image.channels;
+    int rows = (int)std::max((size_t)1, ASSET_UPLOAD_SLICE / rowBytes);
+    rows = std::min(rows, rowCount - progress.row);
+    int y = progress.row * rowHeight, sliceHeight = std::min(rows * rowHeight, height - y);
+
+    if (blocks) {
+        // storage for the whole level first, then the blocks a slice at a time
+        if (progress.row == 0)
+            glCompressedTexImage2D(GL_TEXTURE_2D, progress.level, compressed.format, width, height, 0, (int)compressed.levelBytes[progress.level], NULL);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, progress.level, 0, y, width, sliceHeight, compressed.format, (int)(rows * rowBytes),
+            compressed.levels[progress.level] + progress.row * rowBytes);
+    }
+    else {
+        unsigned int fmt = imageFormat(image);
+        const unsigned char* pixels = progress.level == 0 ? image.pixels : image.mipmaps[progress.level - 1].data();
+        if (progress.row == 0)
+            glTexImage2D(GL_TEXTURE_2D, progress.level, fmt, width, height, 0, fmt, GL_UNSIGNED_BYTE, NULL);
+
+        // rows of an RGB, RG or grey image needn't start on 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, progress.level, 0, y, width, sliceHeight, fmt, GL_UNSIGNED_BYTE, pixels + progress.row * rowBytes);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    progress.row += rows;
+    if (progress.row < rowCount)
+        return false;
+    progress.row = 0;
+    if (++progress.level < levels)
+        return false;
+
+    if (!blocks && image.mipmaps.empty())
+        glGenerateMipmap(GL_TEXTURE_2D);
+    return true;
+}
+
+unsigned int loadTextureAsync(const char* fPath)
+{
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+    unsigned int tNum;
+    glGenTextures(1, &tNum);
+    setupTexture(tNum, (const void*)grey, 1, 1, GL_RGBA);
+
+    struct AsyncTexture {
+        DecodedImage image;
+        CompressedImage compressed;
+        ImageUploadProgress progress;
+    };
+    std::shared_ptr<AsyncTexture> texture = std::make_shared<AsyncTexture>();
+    std::string path = fPath;
+    bool compress = textureCompressionEnabled();
+
+    loadInBackground(
+        [texture, path, compress]() {
+            unsigned int fromCache, encoded;
+            readTextureImages(&path, 1, compress, &texture->image, &texture->compressed, fromCache, encoded);
+        },
+        [texture, tNum, path]() {
+            bool done;
+            do {
+                done = uploadImageSlice(tNum, texture->image, texture->compressed, texture->progress);
+            } while (!done && assetTimeLeft());
+
+            if (done) {
+                if (texture->image.pixels || !texture->compressed.levels.empty())
+                    trackTexture(tNum, GL_TEXTURE_2D, path.c_str());
+                freeImage(texture->image);
+                freeCompressed(texture->compressed);
+            }
+            return done;
+        });
+    return tNum;
 }
 
 std::map<std::string, unsigned int> Texture::texMap;
+
+// ---------------------------------------------------------------
+// the texture cache, see Texture in textures.h
+
+std::map<std::string, unsigned int> Texture::byPath;
+std::map<unsigned long long, unsigned int> Texture::byContent;
+std::map<unsigned int, Texture::Entry> Texture::entries;
+
+// find() runs on the asset loader's thread too, everything else is the render thread's
+static std::mutex textureCacheLock;
+
+bool textureKey(const char* fPath, TextureKey& key)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(fPath, error);
+    key.path = error ? std::string(fPath) : canonical.string();
+    key.hash = 0;
+
+    MappedFile file(fPath);
+    if (!file.good())
+        return false;
+
+    // FNV-1a, a few ms for a big JPEG, nothing next to decoding it
+    unsigned long long hash = 14695981039346656037ull;
+    const unsigned char* bytes = (const unsigned char*)file.data();
+    for (size_t i = 0; i < file.size(); i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    key.hash = hash;
+    return true;
+}
+
+unsigned int Texture::find(const TextureKey& key)
+{
+    std::lock_guard<std::mutex> lock(textureCacheLock);
+
+    auto path = byPath.find(key.path);
+    if (path != byPath.end())
+        return path->second;
+    auto content = key.hash ? byContent.find(key.hash) : byContent.end();
+    return content != byContent.end() ? content->second : 0;
+}
+
+unsigned int Texture::share(const TextureKey& key)
+{
+    std::lock_guard<std::mutex> lock(textureCacheLock);
+
+    auto path = byPath.find(key.path);
+    auto content = key.hash ? byContent.find(key.hash) : byContent.end();
+    unsigned int tNum = path != byPath.end() ? path->second : content != byContent.end() ? content->second : 0;
+    if (tNum == 0)
+        return 0;
+
+    Entry& entry = entries[tNum];
+    entry.references++;
+    // a copy under another name, the name finds it straight away from now on
+    if (byPath.find(key.path) == byPath.end()) {
+        if (texturesVerbose)
+            std::cout << "texture " << key.path << " is the same image as " << entry.paths[0] << "\n";
+        byPath[key.path] = tNum;
+        entry.paths.push_back(key.path);
+    }
+    return tNum;
+}
+
+void Texture::adopt(const TextureKey& key, unsigned int tNum)
+{
+    std::lock_guard<std::mutex> lock(textureCacheLock);
+
+    Entry& entry = entries[tNum];
+    entry.references = 1;
+    entry.paths.assign(1, key.path);
+    entry.hash = key.hash;
+    byPath[key.path] = tNum;
+    if (key.hash)
+        byContent[key.hash] = tNum;
+}
+
+unsigned int Texture::acquire(const char* fPath, bool async)
+{
+    TextureKey key;
+    textureKey(fPath, key);
+
+    unsigned int tNum = share(key);
+    if (tNum)
+        return tNum;
+
+    tNum = async ? loadTextureAsync(fPath) : loadTexture(fPath);
+    adopt(key, tNum);
+    return tNum;
+}
+
+void Texture::acquire(const std::vector<std::string>& paths, std::vector<unsigned int>& textures)
+{
+    std::vector<TextureKey> keys(paths.size());
+    ThreadPool::shared().parallelFor((unsigned)paths.size(), [&](unsigned i) { textureKey(paths[i].c_str(), keys[i]); });
+
+    // what isn't cached is loaded in one go, a file asked for twice (under any name) only once
+    textures.assign(paths.size(), 0);
+    std::vector<std::string> missing;
+    std::vector<unsigned int> missingKey, again;
+    std::map<std::string, unsigned int> missingPaths;
+    std::map<unsigned long long, unsigned int> missingContent;
+
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        if ((textures[i] = share(keys[i])))
+            continue;
+        if (missingPaths.count(keys[i].path) || (keys[i].hash && missingContent.count(keys[i].hash))) {
+            again.push_back(i);
+            continue;
+        }
+        missingPaths[keys[i].path] = (unsigned int)missing.size();
+        if (keys[i].hash)
+            missingContent[keys[i].hash] = (unsigned int)missing.size();
+        missingKey.push_back(i);
+        missing.push_back(paths[i]);
+    }
+
+    std::vector<unsigned int> loaded(missing.size());
+    loadTextures(missing.data(), (unsigned int)missing.size(), loaded.data());
+    for (size_t m = 0; m < missing.size(); m++) {
+        adopt(keys[missingKey[m]], loaded[m]);
+        textures[missingKey[m]] = loaded[m];
+    }
+    for (unsigned int i : again)
+        textures[i] = share(keys[i]);
+}
+
+void Texture::retain(unsigned int tNum)
+{
+    std::lock_guard<std::mutex> lock(textureCacheLock);
+
+    auto entry = entries.find(tNum);
+    if (entry != entries.end())
+        entry->second.references++;
+}
+
+void Texture::release(unsigned int tNum)
+{
+    {
+        std::lock_guard<std::mutex> lock(textureCacheLock);
+
+        auto entry = entries.find(tNum);
+        if (entry == entries.end() || --entry->second.references > 0)
+            return;
+
+        for (const std::string& path : entry->second.paths)
+            byPath.erase(path);
+        auto content = byContent.find(entry->second.hash);
+        if (content != byContent.end() && content->second == tNum)
+            byContent.erase(content);
+        entries.erase(entry);
+    }
+    untrackTexture(tNum);
+    glDeleteTextures(1, &tNum);
+}
+
+size_t Texture::cached()
+{
+    std::lock_guard<std::mutex> lock(textureCacheLock);
+    return entries.size();
+}
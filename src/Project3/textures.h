@@ -1,11 +1,115 @@
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+
 void setupTextures(unsigned int textures[]);
 void deleteTextures(unsigned int textures[]);
+void updateTextures(unsigned int textures[]);
+
+struct RayScene;
+// path traces scene into textures[1] from now on, refining it every frame, the texture takes ownership of scene
+// (the progressive tracer starts here if rayTraceProgressive didn't start it with the demo spheres)
+void showInRayTraceTexture(RayScene* scene);
 
 unsigned int loadTexture(const char* fPath);
 
+// loads count image files into new textures (written to textures), the files are decoded and their mip
+// chains built across ThreadPool::shared(), then uploaded from the render thread through pixel buffers
+// with compressTextures the mip chains come straight from the image's texture cache without a decode, an image
+// without one goes up as pixels and is block compressed and cached on the asset loader's thread (see TextureCache.h)
+// a file that won't load leaves an empty texture behind, like loadTexture()
+void loadTextures(const std::string* paths, unsigned int count, unsigned int* textures);
+extern bool compressTextures;
+// timings and sizes of every texture load on stdout, off in the sandbox (files that won't load are reported either way)
+extern bool texturesVerbose;
+// compressTextures, and the driver takes the blocks, ask on the render thread (it needs GL)
+bool textureCompressionEnabled();
+
+// the six faces in the order +X -X +Y -Y +Z -Z, loaded the same way
+unsigned int loadCubemap(std::vector<std::string> faces);
+
+// bytes loadTextures() puts in one pixel buffer, a bigger batch is split over several
+#define TEXTURE_UPLOAD_BATCH (64 << 20)
+
+// loadTexture() in pieces, so images can be decoded in the background (see AssetLoader.h)
+// decodeImage(), buildMipmaps() and readTextureImages() only read files and are safe on any thread, uploadImageSlice() needs the GL context
+struct DecodedImage {
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = NULL;
+	std::vector<std::vector<unsigned char>> mipmaps;    /// level 1 and down, empty until buildMipmaps()
+};
+// textures are flipped so the first row is at the bottom, cube map faces aren't
+bool decodeImage(const char* fPath, DecodedImage& image, bool flip = true);
+// halves the image down to 1x1 with a box filter, what glGenerateMipmap() does, but on any thread
+void buildMipmaps(DecodedImage& image);
+void freeImage(DecodedImage& image);
+
+struct CompressedImage;
+// what loadTextures() does before it needs GL : an up to date texture cache is mapped into compressed[i], the
+// other images are decoded into images[i] with their mip chains and, with compress, encoded and cached for next time
+// fromCache and encoded count the images that came from caches and the ones that were encoded
+// without encode the images that have no cache are only decoded (loadTextures() encodes them on the loader thread)
+void readTextureImages(const std::string* paths, unsigned int count, bool compress, DecodedImage* images, CompressedImage* compressed,
+	unsigned int& fromCache, unsigned int& encoded, bool encode = true);
+
+// how far uploadImageSlice() has got with an image
+struct ImageUploadProgress {
+	int level = 0, row = 0;     /// row counts rows of blocks for a compressed image
+};
+// uploads the next ASSET_UPLOAD_SLICE worth of rows of the image into tNum, the blocks when compressed has any and the
+// pixels otherwise, level by level (without a mip chain glGenerateMipmap() makes one), the first slice sets the texture up
+// true once the last level is in
+bool uploadImageSlice(unsigned int tNum, const DecodedImage& image, const CompressedImage& compressed, ImageUploadProgress& progress);
+
+// returns a texture name right away and fills it in the background, it is a grey pixel until then
+unsigned int loadTextureAsync(const char* fPath);
+
+// what the texture cache knows an image file by : the canonical path, and the FNV-1a hash of the file's
+// bytes so two copies of one image are one texture as well (0 when the file couldn't be read)
+struct TextureKey {
+	std::string path;
+	unsigned long long hash = 0;
+};
+// reads the whole file, safe on any thread
+bool textureKey(const char* fPath, TextureKey& key);
+
+// the process wide texture cache, every image file is decoded and uploaded once however many models use it
+//
+// a texture is counted once by whoever acquired it and once more by every Material holding it (see Material.h),
+// it is deleted when the last of them lets go, textures the cache didn't load are never counted or deleted
 class Texture {
 public:
 	static std::map<std::string, unsigned int> texMap;
-};
\ No newline at end of file
+
+	// the texture for fPath with one more reference for the caller, decoded and uploaded the first
+	// time (in the background with async, see loadTextureAsync())
+	static unsigned int acquire(const char* fPath, bool async = false);
+	// acquire() for several files at once, the ones that aren't cached are loaded with loadTextures()
+	static void acquire(const std::vector<std::string>& paths, std::vector<unsigned int>& textures);
+
+	// the parts of acquire() for loads that decode somewhere else (ObjModel's background loads) :
+	// find() is safe on any thread and only says whether the image is there right now (0 if not),
+	// share() takes a reference on it from the render thread (0 if it has gone again since), adopt()
+	// puts a new texture in the cache with one reference
+	static unsigned int find(const TextureKey& key);
+	static unsigned int share(const TextureKey& key);
+	static void adopt(const TextureKey& key, unsigned int tNum);
+
+	static void retain(unsigned int tNum);
+	static void release(unsigned int tNum);
+
+	static size_t cached();     /// textures in the cache
+
+private:
+	struct Entry {
+		unsigned int references = 0;
+		std::vector<std::string> paths;     /// every path it was asked for by
+		unsigned long long hash = 0;
+	};
+	static std::map<std::string, unsigned int> byPath;
+	static std::map<unsigned long long, unsigned int> byContent;
+	static std::map<unsigned int, Entry> entries;
+};